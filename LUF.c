@@ -3,6 +3,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <sys/types.h>
+#include <pthread.h>
 #include "LUF.h"
 
 /* Copyright 1996 Uppsala University
@@ -32,6 +33,7 @@
 
 /* Global variables */
 int Line_number = 1;			/* Line number for use inside yyerror */
+char* Source_name = NULL;		/* File name for yyerror, if any */
 
 /*
  * ceprintf:
@@ -64,6 +66,8 @@ void
 int
 yyerror(char* str)
 {
+  if (Source_name != NULL)
+    fprintf(stderr, "%s: ", Source_name);
   fprintf(stderr, "line %d: %s\n", Line_number, str);
   exit(-1);
 }
@@ -87,3 +91,84 @@ newlabel(char* pfx)
 
   return buf;
 }
+
+
+/*
+ * intern:
+ *    Returns the unique copy of a string. Equal strings give the
+ *    same pointer, so every identifier of the input is only stored
+ *    once, however often it occurs. The copies are kept in an open
+ *    addressing hash table and allocated in large blocks. The
+ *    table is shared by the threads that parse at the same time.
+ */
+#define INTERN_BLOCK 65536
+
+static char** intern_table = NULL;
+static unsigned long intern_size = 0;
+static unsigned long intern_count = 0;
+static char* intern_block = NULL;
+static size_t intern_left = 0;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long
+intern_hash(char* str)
+{
+  unsigned long hash = 2166136261UL;
+
+  while (*str)
+    hash = (hash ^ (unsigned char) *str++) * 16777619UL;
+  return hash;
+}
+
+char*
+intern(char* str)
+{
+  unsigned long slot, old_slot;
+  char** old_table;
+  size_t length;
+
+  pthread_mutex_lock(&intern_lock);
+  if (2 * (intern_count + 1) > intern_size) {
+    old_table = intern_table;
+    intern_size = intern_size ? 2 * intern_size : 1024;
+    intern_table = (char**) calloc(intern_size, sizeof(char*));
+    if (intern_table == NULL)
+      PANIC(Out of memory);
+    if (old_table != NULL) {
+      for (old_slot = 0; old_slot < intern_size / 2; old_slot++)
+	if (old_table[old_slot] != NULL) {
+	  slot = intern_hash(old_table[old_slot]) & (intern_size - 1);
+	  while (intern_table[slot] != NULL)
+	    slot = (slot + 1) & (intern_size - 1);
+	  intern_table[slot] = old_table[old_slot];
+	}
+      free(old_table);
+    }
+  }
+
+  slot = intern_hash(str) & (intern_size - 1);
+  while (intern_table[slot] != NULL) {
+    if (strcmp(intern_table[slot], str) == 0) {
+      pthread_mutex_unlock(&intern_lock);
+      return intern_table[slot];
+    }
+    slot = (slot + 1) & (intern_size - 1);
+  }
+
+  length = strlen(str) + 1;
+  if (length > intern_left) {
+    intern_left = length > INTERN_BLOCK ? length : INTERN_BLOCK;
+    intern_block = (char*) malloc(intern_left);
+    if (intern_block == NULL)
+      PANIC(Out of memory);
+  }
+  memcpy(intern_block, str, length);
+  intern_table[slot] = intern_block;
+  intern_block += length;
+  intern_left -= length;
+  intern_count++;
+  str = intern_table[slot];
+  pthread_mutex_unlock(&intern_lock);
+
+  return str;
+}
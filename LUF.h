@@ -14,14 +14,17 @@
  */
 
 extern int Line_number;			/* Defined in LUF.c */
+extern char* Source_name;
 
 #ifdef __STDC__
 int yyerror(char*);
 void ceprintf(char*, ...);
 char* newlabel(char*);
+char* intern(char*);
 #else
 int ceprintf();
 char* newlabel();
+char* intern();
 #endif
 
 #endif
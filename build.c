@@ -0,0 +1,247 @@
+/* build.c
+
+   Build contexts of the reentrant front end: the input of the scanner,
+   the declarations recorded by the parser, and the building of the
+   model from them. Several files can be parsed at the same time on
+   worker threads with parse_models.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "LUF.h"
+#include "fpsmain.h"
+#include "build.h"
+
+#define FIRST_DECLARATIONS 1024
+#define MAX_PARSE_THREADS 8
+
+struct parse_job {
+  struct build_context *contexts;
+  int no_models;
+  int next_model;   /* Taken by the workers with __sync_fetch_and_add */
+};
+
+static void *parse_worker(void *);
+
+/* OPEN_INPUT
+
+   Starts a context that reads the given file. A regular file is
+   mapped into memory from its current position on and read from
+   there instead of through stdio.
+*/
+
+void open_input(struct build_context *context, char *name, FILE *file)
+{
+  struct stat status;
+  off_t start;
+  char *map;
+
+  open_buffer(context, name, NULL, 0);
+  context->file = file;
+  start = lseek(fileno(file), 0, SEEK_CUR);
+  if ((start >= 0) && (fstat(fileno(file), &status) == 0) &&
+      S_ISREG(status.st_mode) && (status.st_size > start)) {
+    map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (map != MAP_FAILED) {
+      context->buffer = map;
+      context->size = status.st_size;
+      context->position = start;
+      context->mapped = 1;
+    }
+  }
+}
+
+/* Starts a context that reads a buffer in memory, which must stay
+   valid until the input is closed */
+
+void open_buffer(struct build_context *context, char *name, char *buffer, size_t size)
+{
+  context->name = name;
+  context->line = 1;
+  context->file = NULL;
+  context->buffer = buffer;
+  context->size = size;
+  context->position = 0;
+  context->mapped = 0;
+  context->declarations = NULL;
+  context->no_declarations = context->max_declarations = 0;
+}
+
+/* Ends the input, but keeps the declarations for build_model */
+
+void close_input(struct build_context *context)
+{
+  if (context->mapped)
+    munmap(context->buffer, context->size);
+  context->buffer = NULL;
+  context->mapped = 0;
+  context->file = NULL;
+}
+
+/* RECORD
+
+   Called by the parser to record a declaration for build_model, with
+   the current line for the error messages
+*/
+
+void record(struct build_context *context, int kind, char *name, char *operand, double value, int action)
+{
+  struct declaration *declaration;
+
+  if (context->no_declarations == context->max_declarations) {
+    context->max_declarations = context->max_declarations ? 2 * context->max_declarations : FIRST_DECLARATIONS;
+    context->declarations = realloc(context->declarations, context->max_declarations * sizeof(struct declaration));
+    if (context->declarations == NULL) {
+      fprintf(stderr, "Failed to allocate memory for the declarations.\n");
+      exit(-1);
+    }
+  }
+  declaration = &context->declarations[context->no_declarations++];
+  declaration->kind = kind;
+  declaration->action = action;
+  declaration->line = context->line;
+  declaration->name = name;
+  declaration->operand = operand;
+  declaration->value = value;
+}
+
+/* BUILD_ERROR
+
+   Reports an error in the input of a context, like ceprintf, and
+   stops
+*/
+
+void build_error(struct build_context *context, char *format, ...)
+{
+  char message[1024];
+  va_list arguments;
+
+  va_start(arguments, format);
+  vsnprintf(message, sizeof(message), format, arguments);
+  va_end(arguments);
+  if (context->name != NULL)
+    fprintf(stderr, "%s: ", context->name);
+  fprintf(stderr, "line %d: %s\n", context->line, message);
+  exit(-1);
+}
+
+/* PARSE_MODELS
+
+   Parses the files named in the contexts, on the given number of
+   threads. Each file must hold a model of its own.
+*/
+
+void parse_models(struct build_context *contexts, int no_models, int threads)
+{
+  pthread_t workers[MAX_PARSE_THREADS];
+  struct parse_job job;
+  int counter;
+
+  job.contexts = contexts;
+  job.no_models = no_models;
+  job.next_model = 0;
+  if (threads > no_models)
+    threads = no_models;
+  if (threads > MAX_PARSE_THREADS)
+    threads = MAX_PARSE_THREADS;
+
+  for (counter = 1; counter < threads; counter++)
+    if (pthread_create(&workers[counter], NULL, parse_worker, &job) != 0) {
+      fprintf(stderr, "Can't start a worker thread.\n");
+      exit(-1);
+    }
+  parse_worker(&job);
+  for (counter = 1; counter < threads; counter++)
+    pthread_join(workers[counter], NULL);
+}
+
+static void *parse_worker(void *data)
+{
+  struct parse_job *job = data;
+  struct build_context *context;
+  FILE *file;
+  int model;
+
+  while ((model = __sync_fetch_and_add(&job->next_model, 1)) < job->no_models) {
+    context = &job->contexts[model];
+    file = fopen(context->name, "r");
+    if (file == NULL) {
+      fprintf(stderr, "Can't open `%s'.\n", context->name);
+      exit(-1);
+    }
+    open_input(context, context->name, file);
+    parse_model(context);
+    close_input(context);
+    fclose(file);
+  }
+  return(NULL);
+}
+
+/* BUILD_MODEL
+
+   Enters the declarations of a parsed context into the model, which
+   must have been cleared by initialise, and returns the number of
+   systems. The errors found here are reported with the line of the
+   declaration. The declarations are freed.
+*/
+
+int build_model(struct build_context *context)
+{
+  struct declaration *declaration;
+  int counter;
+
+  Source_name = context->name;
+  system_registry(RESET_SYSTEMS);
+  for (counter = 0; counter < context->no_declarations; counter++) {
+    declaration = &context->declarations[counter];
+    Line_number = declaration->line;
+    switch (declaration->kind)
+      {
+      case SYSTEM_DEC :
+	declare_system(declaration->name, declaration->operand);
+	break;
+      case VARIABLE_DEC :
+	declare_variable(declaration->name, declaration->action);
+	break;
+      case GLOBAL_VARIABLE_DEC :
+	declare_global_variable(declaration->name, declaration->action);
+	break;
+      case TASK_DEC :
+	declare_task(declaration->name);
+	break;
+      case GLOBAL_TASK_DEC :
+	declare_global_task(declaration->name);
+	break;
+      case SEMAPHORE_DEC :
+	add_semaphore(declaration->name, declaration->operand, declaration->value);
+	break;
+      case INIT_DEC :
+	if (declaration->action == INIT_COLUMN)
+	  init_column(declaration->operand);
+	else
+	  init_variable(declaration->name, declaration->operand, declaration->value);
+	break;
+      case FORMULA_DEC :
+	declare_formula(declaration->name, declaration->action);
+	break;
+      case OPERATION_DEC :
+	declare_operation(declaration->action);
+	break;
+      case CONSTANT_DEC :
+	declare_constant(declaration->value);
+	break;
+      }
+  }
+  free(context->declarations);
+  context->declarations = NULL;
+  context->no_declarations = context->max_declarations = 0;
+  return(system_registry(GET_SYSTEM) + 1);
+}
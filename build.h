@@ -0,0 +1,51 @@
+#ifndef __BUILD
+#define __BUILD
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* The front end (parser.y and lexer.l) is reentrant: everything it
+   needs is kept in a build context, one per input, so that several
+   inputs can be parsed at the same time. The parser doesn't touch the
+   model, it records the declarations in the context, and build_model
+   enters them into the model afterwards, one model at a time. */
+
+typedef enum { SYSTEM_DEC, VARIABLE_DEC, GLOBAL_VARIABLE_DEC, TASK_DEC, GLOBAL_TASK_DEC,
+	       SEMAPHORE_DEC, INIT_DEC, FORMULA_DEC, OPERATION_DEC, CONSTANT_DEC } dec_t;
+
+struct declaration {
+  int kind;   /* dec_t */
+  int action;   /* Variable type, formula action or operation */
+  int line;
+  char *name, *operand;   /* Interned, or NULL */
+  double value;
+};
+
+struct build_context {
+  char *name;   /* File name for the messages, NULL for standard input */
+  int line;
+
+  /* The input: a file read through stdio, or a buffer in memory, which
+     is also used for regular files mapped into memory */
+
+  FILE *file;
+  char *buffer;
+  size_t size, position;
+  int mapped;
+
+  struct declaration *declarations;
+  int no_declarations, max_declarations;
+};
+
+/* Prototypes */
+
+void open_input(struct build_context *, char *, FILE *);
+void open_buffer(struct build_context *, char *, char *, size_t);
+void close_input(struct build_context *);
+void record(struct build_context *, int, char *, char *, double, int);
+void build_error(struct build_context *, char *, ...);
+int parse_model(struct build_context *);
+void parse_models(struct build_context *, int, int);
+int build_model(struct build_context *);
+
+#endif
@@ -28,7 +28,25 @@
 #include <ctype.h>
 #include <limits.h>
 #include <float.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
 #include "fpsmain.h"
+#include "trace.h"
+#include "build.h"
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec   /* The nanoseconds of the times of a file */
+#endif
 
 /* Constants */
                        
@@ -37,21 +55,62 @@
 #define FALSE 0
 #define STACK_SIZE 100
 #define MAX_SYSTEMS 10
+#define MAX_WORKERS 8
+#define MAX_SLOTS (MAX_SYSTEMS + MAX_WORKERS)   /* Scratch systems for the workers */
+#define MAX_STACKS (MAX_SLOTS + MAX_WORKERS)   /* Stacks of the summation workers after the slots */
 #define MAX_VARIABLES 50
-#define MAX_TASKS 50
+#ifndef MAX_TASKS
+#define MAX_TASKS 50   /* Can be raised with -DMAX_TASKS=n for big task sets */
+#endif
 #define MAX_FORMULAS 50
+#ifndef MAX_MATRIX_ELEMENTS
+#define MAX_MATRIX_ELEMENTS 10000   /* Of all matrices of a system, n * n each for n tasks */
+#endif
 #define MAX_SEMAPHORES 50
+#define MAX_KERNEL_TERMS 10
+#define MAX_READS 32
+#define MAX_GROUPS 16
+#define MAX_FACTOR 65536.0   /* Sensitivity searches give up beyond this */
+#define FACTOR_PRECISION 1e-6
+#define AFFINE_ULPS 4.0   /* Rounding error of a solved fixed point that is accepted */
+#define MAX_POINTS 1000
+#define MAX_PERIODS 64
+#define MAX_SELECTED 64   /* Elements given with --only */
+#define CAMPAIGN_CHUNK 16   /* Task sets taken by a worker at a time */
+#define SIGMA_CHUNK 64   /* Elements of a summation added up one after the other */
+#define SIGMA_PARALLEL 16   /* Chunks before a summation is shared by the -j threads */
+#define MAX_CHUNKS (MAX_TASKS / SIGMA_CHUNK + 2)   /* At least a pair */
+#define MAX_INNER_SUMS 8   /* Nested summations of a system whose sums are kept */
+#ifndef MAX_REFRESHES
+#define MAX_REFRESHES 64   /* Priority refreshes of a system in one round before giving up */
+#endif
+#define EXACT_LIMIT 4503599627370496.0   /* 2^52, below which doubles hold integers exactly */
 #define INVALID -1
 #define UNDEFINED -1
 #define STRING_SIZE 80
+#define MAX_SECTIONS 32
+#define FORMULA_TABLE (2 * MAX_SYSTEMS * MAX_FORMULAS)   /* Slots of the table of share_formulas */
+#define MODEL_MAGIC "FPSB"
+#define MODEL_VERSION 4
+#define PATH_SIZE 1024
+#define MESSAGE_SIZE 256
+#define WATCH_INTERVAL 200000   /* Microseconds between the checks of --watch */
+#define POSITIVE 1
+#define NEGATIVE 2
+#define CACHE_STAMP __DATE__ " " __TIME__   /* Results of another build aren't reused */
+#define ALIGNED(size) (((size) + 7) & ~(size_t) 7)
 
 /* Type defs */
 
 typedef enum { DEF_FIELD, CONST_FIELD, OP_FIELD, VAR_FIELD } form_field_t;
-typedef enum { SINGLE_INDEX, I_INDEX, J_INDEX, SCALAR } index_t;
-typedef enum { PLUS, MINUS, MULTIPLY, DIVIDE, UMINUS, MIN, MAX, FLOOR, CEILING, SIGMA_HP, SIGMA_LP, SIGMA_ALL, SIGMA_EP, END_SIGMA } op_t;
+typedef enum { SINGLE_INDEX, I_INDEX, J_INDEX, SCALAR, K_INDEX } index_t;
 typedef struct formula *formula_t;
 typedef enum { GLOBAL_RESULT, LOCAL_RESULT } result_t;
+typedef enum { UNDECIDED, SCHEDULABLE, UNSCHEDULABLE } verdict_t;
+typedef enum { EXACT_TEST, UTILISATION_TEST, UPPER_BOUND_TEST, LOWER_BOUND_TEST } test_t;
+typedef enum { KEPT_SYSTEM, WARM_SYSTEM, COLD_SYSTEM } restart_t;
+typedef struct rta_kernel *rta_kernel_t;
+typedef unsigned __int128 hash_t;
 
 struct formula {
   int field_type;
@@ -63,32 +122,414 @@ struct formula {
 	char variable_name[80];
 	char variable_index_task[80];
 	int index_type;
+	char column_task[80];
+	int column_type;   /* INVALID unless an element of a matrix is read */
+	int variable;      /* The names resolved by resolve_formula */
+	int global;
+	int task;
+	int column;
       } var_field;
     } op_field;
     struct {
       int index_type;
       char result_variable[80];
       char result_index_task[80];
+      int column_type;   /* J_INDEX for a matrix, otherwise INVALID */
+      int variable;      /* The names resolved by resolve_formula */
+      int global;
+      int task;
     } definition;
   } func_field;
   formula_t next;
 };
 
+/* A formula of the form
+
+     R[i] = C[i] + B[i] + sigma(hp, ceiling((R[i]+J[j])/T[j])*C[j]);
+
+   is recognised after parsing and evaluated by rta_kernel instead of
+   parse_rpn. The terms outside the summation are kept in the order
+   they appear in the formula, so the result is the same as that of
+   the interpreter. */
+
+struct rta_kernel {
+  int no_terms;
+  int term_type[MAX_KERNEL_TERMS];   /* CONST_FIELD, VAR_FIELD or OP_FIELD */
+  int term_index_type[MAX_KERNEL_TERMS];   /* I_INDEX or SCALAR */
+  int term_variable[MAX_KERNEL_TERMS];
+  double term_constant[MAX_KERNEL_TERMS];
+  int response_variable;   /* The i-indexed variable inside the ceiling */
+  int jitter_variable;   /* INVALID if no jitter is added */
+  int period_variable;
+  int cost_variable;
+  int jump;   /* The ceiling reads the result itself, see rta_jump */
+};
+
+/* The higher priority tasks of a kernel summation, grouped by period
+   and jitter, which give the same ceiling for all tasks of a group.
+   cost_sums[p][g] is the sum of the costs of the tasks of group g
+   among the first p tasks in priority order, and level[i] is the
+   number of tasks with a higher priority than task i. */
+
+struct task_groups {
+  int usable;
+  int formula;
+  unsigned long stamp;
+  int no_groups;
+  double group_period[MAX_GROUPS];
+  double group_jitter[MAX_GROUPS];
+  double cost_sums[MAX_TASKS + 1][MAX_GROUPS];
+  int level[MAX_TASKS];
+  double largest_jitter, smallest_period, total_cost;
+};
+
+/* The variables a formula reads, so that evaluations whose inputs
+   haven't changed can be skipped. A read indexed by `i' depends on
+   the element of the task being evaluated, one with a task name on
+   that element, and all others on the whole variable. Formulas with
+   reads that can't be tracked are always evaluated. */
+
+struct formula_reads {
+  int untracked;
+  int no_reads;
+  int variable[MAX_READS];
+  int index_type[MAX_READS];
+  int task[MAX_READS];
+  int global[MAX_READS];
+};
+
+/* A precompiled model (--compile, --load) starts with this header */
+
+struct model_header {
+  char magic[4];
+  int version;
+  int byte_order;
+  int sizes[8];
+  int no_systems;
+  int no_fields;
+};
+
+struct model_section {
+  void *data;
+  size_t size;
+};
+
+/* A request of the server (--serve), one JSON object per line. Absent
+   strings are empty. */
+
+struct request {
+  char command[STRING_SIZE];
+  char file[PATH_SIZE];
+  char system[STRING_SIZE];
+  char variable[STRING_SIZE];
+  char task[STRING_SIZE];
+  double value;
+  int has_value;
+};
+
+/* What a --watch run leaves for the next one: a description of each
+   system and of the global declarations, to find out what was edited,
+   and the initial and converged values */
+
+struct snapshot {
+  int no_systems;
+  char system_names[MAX_SYSTEMS][STRING_SIZE];
+  char *descriptions[MAX_SYSTEMS];
+  char *global_description;
+  double initial[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];
+  double values[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];
+  double global_initial[MAX_VARIABLES][MAX_TASKS];
+  double global_values[MAX_VARIABLES][MAX_TASKS];
+};
+
+/* The results a run in a child process of the server hands back */
+
+struct served_results {
+  double variables[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];
+  double global_variables[MAX_VARIABLES][MAX_TASKS];
+};
+
+/* The state of one connection to the server */
+
+struct session {
+  int loaded;
+  int no_systems;
+  int stale;
+  int quit;
+  long requests;
+  double started;
+  char message[MESSAGE_SIZE];
+  struct served_results *results;   /* Shared with the children */
+};
+
+/* The variants analysed side by side by analyse_variants, shared by
+   the worker threads */
+
+struct variant_job {
+  int no_variants;
+  int variants[MAX_SYSTEMS];
+  int next_variant;
+  int side_by_side;
+  pthread_mutex_t lock;
+};
+
+/* The candidates of one priority level in Audsley's algorithm, shared
+   by the worker threads */
+
+struct audsley_job {
+  int system;
+  int level;
+  int response_formula;
+  int response_variable;
+  int limit_variable;
+  int no_candidates;
+  int candidates[MAX_TASKS];
+  int schedulable[MAX_TASKS];
+  int next_candidate;
+  int next_slot;
+  int own_elements;   /* Only the elements of a candidate have to be calculated */
+  double globals[MAX_VARIABLES][MAX_TASKS];   /* Put back after each test */
+  pthread_mutex_t lock;
+};
+
+/* The searches of a sensitivity analysis of one system, shared by the
+   worker threads. A search finds how far the variable can be scaled
+   for one task, or for all tasks if the task is INVALID. */
+
+struct sensitivity_job {
+  int system;
+  int variable;
+  int response_variable;
+  int limit_variable;
+  int warm_start;
+  int no_searches;
+  int tasks[MAX_TASKS + 1];
+  double factors[MAX_TASKS + 1];
+  int next_search;
+  int next_slot;
+  pthread_mutex_t lock;
+};
+
+/* A randomised schedulability campaign (--campaign). The task sets
+   are numbered from 0 to no_points * sets - 1 and handed out to the
+   workers in chunks. Each worker counts its own results, which are
+   added up at the end. */
+
+struct campaign_job {
+  int system;
+  int sets;
+  int no_points;
+  double first_utilisation;
+  double utilisation_step;
+  int no_periods;   /* 0 for log-uniform periods in [period_min, period_max] */
+  double periods[MAX_PERIODS];
+  double period_min, period_max;
+  unsigned long long seed;
+  int response_variable;
+  int limit_variable;
+  int period_variable;
+  int cost_variable;
+  long next_set;
+  long no_sets;
+  pthread_mutex_t lock;
+};
+
+struct campaign_worker {
+  struct campaign_job *job;
+  int slot;
+  long schedulable[MAX_POINTS];
+  double total_time[MAX_POINTS];
+  double longest_time[MAX_POINTS];
+};
+
+/* The elements of a summation. The elements are added up in chunks
+   of SIGMA_CHUNK tasks, and the sums of the chunks in pairs, so the
+   result doesn't depend on the number of threads. */
+
+struct sigma_terms {
+  formula_t position;
+  int operation;
+  int index_i;
+  int index_j;   /* INVALID, or the task of the outer summation */
+  int current_system;
+  int result_type;
+  int max_index;
+  int no_chunks;
+  double sums[MAX_CHUNKS];
+};
+
+/* The sums of a nested summation for each task j of the outer one.
+   Only nested summations that don't read anything indexed by `i' are
+   kept; their sums are valid while nothing they read changes, which
+   is checked like needs_evaluation does. */
+
+struct inner_sum {
+  formula_t sigma;
+  struct formula_reads reads;
+  unsigned long stamp[MAX_TASKS];
+  unsigned long global_stamp[MAX_TASKS];
+  double sums[MAX_TASKS];
+};
+
+/* The summation shared by the worker threads of sigma_sum. Worker n
+   (from 1) adds up the chunks n, n + no_workers + 1 and so on, the
+   thread of the analysis the chunks from 0. */
+
+struct sigma_job {
+  struct sigma_terms *terms;
+  int no_workers;
+  int generation;
+  int finished;
+  pid_t pid;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+};
+
 /* Prototypes */
 
 void push(double, int);
 double pop(int);
-double parse_rpn(formula_t, int, int, int, int);
-double sigma_hp(formula_t, int, int, int);
-double sigma_lp(formula_t, int, int, int);
-double sigma_all(formula_t, int, int, int);
-double sigma_ep(formula_t, int, int, int);
+double parse_rpn(formula_t, int, int, int, int, int);
+double matrix_element(formula_t, int, int, int, int, int);
+int field_task(int, int, int, int, int, int, int);
+int evaluate_row(int, int, int, int);
+void set_matrix_element(int, int, int, int, double);
+void place_matrix(int, int);
+void init_matrix(int, int, char *, char *, double);
+void output_matrix(int, int, int, int);
+formula_t end_of_sigma(formula_t);
+double sigma_hp(formula_t, int, int, int, int);
+double sigma_lp(formula_t, int, int, int, int);
+double sigma_all(formula_t, int, int, int, int);
+double sigma_sum(formula_t, int, int, int, int, int);
+double add_terms(struct sigma_terms *);
+struct inner_sum *find_inner_sum(formula_t, int);
+int fresh_inner_sum(struct inner_sum *, int, int);
+void collect_inner_sums(int);
+double sigma_chunk(struct sigma_terms *, int);
+int sigma_member(int, int, int, int);
+double pairwise_sum(double *, int);
+void start_sigma_workers(void);
+void *sigma_worker(void *);
+double evaluate_formula(int, int, int, int);
+double affine_solution(double, double, double);
+void report_divergence(int, int, int);
+double rta_kernel(rta_kernel_t, int, int, int);
+double rta_jump(rta_kernel_t, int, int, double, double);
+struct task_groups *group_tasks(rta_kernel_t, int, int);
+void compile_kernels(int);
+void compile_affine(int);
+int affine_formula(formula_t, int);
+void resolve_formula(formula_t, int);
+char *result_name(formula_t, int);
+char *result_task(formula_t, int);
+char *field_name(formula_t, int);
+char *field_task_name(formula_t, int);
+char *column_task_name(formula_t, int);
+void share_formulas(int);
+unsigned long hash_formula(formula_t);
+size_t field_bytes(formula_t, unsigned char *);
+int same_formula(formula_t, formula_t);
+void free_formula(int, int);
+void collect_reads(int);
+void add_read(struct formula_reads *, int, int, int, int);
+void add_field_read(struct formula_reads *, formula_t, int, int);
+int needs_evaluation(int, int, int);
+void set_element(int, int, int, double);
+void set_global_element(int, int, double);
+void touch_system(int);
+void touch_globals(void);
+rta_kernel_t match_kernel(formula_t, int);
+formula_t match_kernel_sigma(formula_t, rta_kernel_t, int);
+int match_local_variable(formula_t, int, int);
+double kernel_base(rta_kernel_t, int, int);
+int kernel_reads(rta_kernel_t, int, int);
+int prefilter(int);
+void priority_order(int, int *);
+void evaluation_order(int);
+void output_verdicts(int);
+void output_results(int);
+void output_selection(int);
+void usage(void);
+void analyse(int);
+int system_round(int);
+void analyse_variants(int, int *);
+void *variant_worker(void *);
+int warm_variant(int, int *);
+void system_dependencies(int);
+int next_system(int *, int);
+void parse_selection(char *);
+void select_cone(int);
+int want(int, int, int, int);
+void append_field(int);
+int find_response_formula(int);
+int deadline_limit(int, int);
+int formula_writes(int, int);
+void clone_system(int, int);
+void reset_system(int);
+int audsley(int);
+void *audsley_worker(void *);
+int test_candidate(struct audsley_job *, int, int);
+int own_elements(int);
+void sensitivity(int, char *);
+void *sensitivity_worker(void *);
+double critical_factor(struct sensitivity_job *, int, int);
+int probe(struct sensitivity_job *, int, int, double, double *, int *);
+void campaign(int);
+void *campaign_worker(void *);
+int analyse_random_set(struct campaign_job *, int, long);
+double next_random(unsigned long long *);
+int model_sections(int, struct model_section *);
+void add_section(struct model_section *, int *, void *, size_t);
+void model_header(struct model_header *, int, int);
+void save_model(char *, int);
+int shared_head(int [][MAX_FORMULAS], int, int);
+hash_t hash_bytes(hash_t, void *, size_t);
+void cache_key(int, char *);
+int cached_results(int);
+void store_results(void);
+void release_cache(void);
+void copy_output(int);
+void write_section(FILE *, void *, size_t);
+int load_model(char *);
+int damaged_tables(int);
+int damaged_formula(formula_t, int);
+void serve(char *);
+void serve_session(FILE *, FILE *, int);
+void keep_model(int);
+void restore_model(int);
+char *serve_request(struct session *, struct request *, FILE *);
+int serve_load(char *);
+pid_t serve_fork(int *);
+char *serve_wait(struct session *, pid_t, int);
+char *find_target(struct session *, struct request *, int *, int *, int *, int *);
+char *parse_request(char *, struct request *);
+char *parse_string(char *, char *, int);
+char *skip_space(char *);
+void json_string(FILE *, char *);
+void watch(char *);
+int watch_check(char *, char *, size_t);
+char *read_file(char *, size_t *);
+void take_snapshot(int);
+void snapshot_values(int);
+void reuse_snapshot(int, int *);
+int grown(int, double [][MAX_TASKS], int);
+int monotone_system(int);
+int polarities(int, char *);
+char *describe(int);
+void json_number(FILE *, double);
+double now(void);
+double sigma_ep(formula_t, int, int, int, int);
 double max(double, double);
 double min(double, double);
-int initialise();
+int initialise(struct build_context *);
 void calculate_blocking(int);
 int check_dynamic_blocking (int);
 int priority_refresh(int);
+hash_t priority_hash(double *, int);
+void refresh_reset(int, double *);
+int static_priorities(int);
 char *get_word(char *, int);
 char *cmpstr(char *, char *);
 int get_variable_index(char *, int);
@@ -102,135 +543,871 @@ int check_global_task(char *);
 int calculate_task_set(int);
 void output_variables(int);
 char *get_next_line(char *);
-extern int yyparse(void);
 extern void ceprintf(char* fmt, ...);
 
 /* Global variables */
 
-double stack[MAX_SYSTEMS][STACK_SIZE];
-int stack_pointer[MAX_SYSTEMS];
-double variables[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];
-double backup_vars[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];
+double stack[MAX_STACKS][STACK_SIZE];
+int stack_pointer[MAX_STACKS];
+__thread int stack_slot = INVALID;   /* The stack of a summation worker */
+__thread int side_by_side = FALSE;   /* Analysing a variant next to others */
+double variables[MAX_SLOTS][MAX_VARIABLES][MAX_TASKS];
+double backup_vars[MAX_SLOTS][MAX_VARIABLES][MAX_TASKS];
 double global_backup_vars[MAX_VARIABLES][MAX_TASKS];
-double semaphores[MAX_SYSTEMS][MAX_SEMAPHORES][MAX_TASKS];
-int variable_types[MAX_SYSTEMS][MAX_VARIABLES];
-char system_names[MAX_SYSTEMS][STRING_SIZE];
-char variable_names[MAX_SYSTEMS][MAX_VARIABLES][STRING_SIZE];
-char task_names[MAX_SYSTEMS][MAX_TASKS][STRING_SIZE];
-char semaphore_names[MAX_SYSTEMS][MAX_SEMAPHORES][STRING_SIZE];
-formula_t formulas[MAX_SYSTEMS][MAX_FORMULAS];
-int priority_variable[MAX_SYSTEMS];
-int blocking_variable[MAX_SYSTEMS];
+double semaphores[MAX_SLOTS][MAX_SEMAPHORES][MAX_TASKS];
+double matrix_elements[MAX_SLOTS][MAX_MATRIX_ELEMENTS];
+double backup_matrix_elements[MAX_SLOTS][MAX_MATRIX_ELEMENTS];
+int matrix_offset[MAX_SLOTS][MAX_VARIABLES];   /* Where a matrix starts in matrix_elements, row after row */
+int matrix_size[MAX_SLOTS];   /* Elements of matrix_elements in use */
+int variable_types[MAX_SLOTS][MAX_VARIABLES];
+char system_names[MAX_SLOTS][STRING_SIZE];
+char variable_names[MAX_SLOTS][MAX_VARIABLES][STRING_SIZE];
+char task_names[MAX_SLOTS][MAX_TASKS][STRING_SIZE];
+char semaphore_names[MAX_SLOTS][MAX_SEMAPHORES][STRING_SIZE];
+formula_t formulas[MAX_SLOTS][MAX_FORMULAS];
+rta_kernel_t kernels[MAX_SLOTS][MAX_FORMULAS];
+int affine[MAX_SLOTS][MAX_FORMULAS];   /* Affine in the element it gives (see affine_formula) */
+struct formula_reads reads[MAX_SLOTS][MAX_FORMULAS];
+struct task_groups groups[MAX_SLOTS];
+unsigned long clock_ticks[MAX_SLOTS], touched[MAX_SLOTS];
+unsigned long versions[MAX_SLOTS][MAX_VARIABLES][MAX_TASKS];
+unsigned long variable_versions[MAX_SLOTS][MAX_VARIABLES];
+unsigned long evaluated[MAX_SLOTS][MAX_FORMULAS][MAX_TASKS];
+unsigned long global_evaluated[MAX_SLOTS][MAX_FORMULAS][MAX_TASKS];
+unsigned long global_clock, global_touched;
+unsigned long global_versions[MAX_VARIABLES][MAX_TASKS];
+unsigned long global_variable_versions[MAX_VARIABLES];
+int system_reads[MAX_SYSTEMS][MAX_VARIABLES];
+int system_rank[MAX_SYSTEMS];
+int priority_variable[MAX_SLOTS];
+int blocking_variable[MAX_SLOTS];
+int deadline_variable[MAX_SLOTS];
 char global_variable_names[MAX_VARIABLES][STRING_SIZE];
 char global_task_names[MAX_TASKS][STRING_SIZE];
 int global_variable_types[MAX_VARIABLES];
 double global_variables[MAX_VARIABLES][MAX_TASKS];
-double ceiling[MAX_SYSTEMS][MAX_SEMAPHORES];
-int no_tasks[MAX_SYSTEMS];
-int no_vars[MAX_SYSTEMS];
-int no_semaphores[MAX_SYSTEMS];
-int no_formulas[MAX_SYSTEMS];
-int dynamic_blocking[MAX_SYSTEMS];
-int blocking[MAX_SYSTEMS];
+double ceiling[MAX_SLOTS][MAX_SEMAPHORES];
+int no_tasks[MAX_SLOTS];
+int no_vars[MAX_SLOTS];
+int no_semaphores[MAX_SLOTS];
+int no_formulas[MAX_SLOTS];
+int dynamic_blocking[MAX_SLOTS];
+int blocking[MAX_SLOTS];
+int only_task[MAX_SLOTS];
+int task_order[MAX_SLOTS][MAX_TASKS];
+int priority_ordered;
+int cutoff_variable[MAX_SLOTS];
+int cutoff_limit[MAX_SLOTS];
+int cutoff_task[MAX_SLOTS];   /* The only task whose deadline counts, or INVALID for all */
+int deadline_missed[MAX_SLOTS];
+int decided[MAX_SYSTEMS];
+int verdict_formula[MAX_SYSTEMS];
+int verdicts[MAX_SYSTEMS][MAX_TASKS];
+int verdict_tests[MAX_SYSTEMS][MAX_TASKS];
+double verdict_bounds[MAX_SYSTEMS][MAX_TASKS];
+int utilisation_test[MAX_SYSTEMS];
+double utilisation[MAX_SYSTEMS];
+double hyperbolic_product[MAX_SYSTEMS];
+char selected_variables[MAX_SELECTED][STRING_SIZE];
+char selected_tasks[MAX_SELECTED][STRING_SIZE];   /* Empty for all tasks */
+int no_selected;
+char wanted[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];
+char global_wanted[MAX_VARIABLES][MAX_TASKS];
+char needed[MAX_SYSTEMS][MAX_FORMULAS][MAX_TASKS];
+int system_needed[MAX_SYSTEMS];
+int converged[MAX_SYSTEMS];
+hash_t refresh_history[MAX_SYSTEMS][MAX_REFRESHES];   /* The priorities of each refresh of a round */
+int no_refreshes[MAX_SYSTEMS];
+char stale[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];   /* The elements a priority refresh resets */
+int base_system[MAX_SYSTEMS];   /* The system a variant extends, or INVALID */
+char inherited_formulas[MAX_FORMULAS];   /* Of the variant being declared, those of its base */
+struct sigma_job sigma_job;
+struct inner_sum inner_sums[MAX_SLOTS][MAX_INNER_SUMS];
+int no_inner_sums[MAX_SLOTS];
+struct snapshot snapshot;
+
+formula_t new_formula, last_field;   /* The formula being declared */
+int sigma_depth;   /* Summations open in it */
+char *init_matrix_column;   /* The column of the matrix element initialised next, or NULL */
+int formulas_allocated;   /* FALSE if they are in a loaded model file */
 
 FILE *input_file;
-int verbose, no_global_variables, no_global_tasks;
+char *model_input, *model_output;
+char *cache_directory;
+char cache_file[PATH_SIZE], cache_temp[PATH_SIZE];
+int saved_output;   /* Standard output while the results go to cache_temp */
+char *sensitivity_name;
+int campaign_sets;
+double utilisation_range[3];
+char *period_spec;
+unsigned long long campaign_seed;
+double model_variables[MAX_SYSTEMS][MAX_VARIABLES][MAX_TASKS];
+double model_global_variables[MAX_VARIABLES][MAX_TASKS];
+int verbose, verdicts_only, assign_priorities, threads, no_global_variables, no_global_tasks;
+int watching;   /* Errors in the analysis mustn't end --watch */
 
 int main(int argc,
 	  char *argv[])
 {
   int no_systems,
   current_system,
-  current_formula,
-  current_index,
-  overall_change,
-  result_var_index,
-  result_var_type;
-  char result_var_name[STRING_SIZE];
-  double scalar_result;
+  serving,
+  counter,
+  no_models,
+  model;
+  char *socket_name, *watch_file;
+  struct build_context *contexts;
 
   fprintf(stderr, "This is fpscalc version 2.02 1997\n");
 
   verbose = FALSE;
-  if (argc > 2) {
-    fprintf(stderr, "Usage: fpscalc [-v]\n");
+  verdicts_only = FALSE;
+  assign_priorities = FALSE;
+  priority_ordered = FALSE;
+  sensitivity_name = NULL;
+  campaign_sets = 0;
+  utilisation_range[0] = utilisation_range[2] = 0.05;
+  utilisation_range[1] = 1.0;
+  period_spec = "10:1000";
+  campaign_seed = 1;
+  no_selected = 0;
+  threads = 1;
+  model_input = model_output = NULL;
+  cache_directory = NULL;
+  saved_output = INVALID;
+  serving = FALSE;
+  socket_name = NULL;
+  watch_file = NULL;
+  contexts = malloc(argc * sizeof(struct build_context));
+  if (contexts == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the models.\n");
     exit(-1);
   }
-
-  if (argc == 2) {
-    if (strcmp(argv[1], "-v") == 0)
+  no_models = 0;
+  for (counter = 1; counter < argc; counter++) {
+    if (strcmp(argv[counter], "-v") == 0)
       verbose = TRUE;
-    else {
-      fprintf(stderr, "Usage: fpscalc [-v]\n");
-      exit(-1);
+    else if (strcmp(argv[counter], "-s") == 0)
+      verdicts_only = TRUE;
+    else if (strcmp(argv[counter], "-a") == 0)
+      assign_priorities = TRUE;
+    else if (strcmp(argv[counter], "-p") == 0)
+      priority_ordered = TRUE;
+    else if ((strcmp(argv[counter], "--sensitivity") == 0) && (counter + 1 < argc))
+      sensitivity_name = argv[++counter];
+    else if ((strcmp(argv[counter], "--campaign") == 0) && (counter + 1 < argc)) {
+      campaign_sets = atoi(argv[++counter]);
+      if (campaign_sets < 1)
+	usage();
+    }
+    else if ((strcmp(argv[counter], "--utilisation") == 0) && (counter + 1 < argc)) {
+      if (sscanf(argv[++counter], "%lf:%lf:%lf", &utilisation_range[0], &utilisation_range[1], &utilisation_range[2]) != 3)
+	usage();
+      if (!(utilisation_range[0] > 0.0) || !(utilisation_range[1] >= utilisation_range[0]) || !(utilisation_range[2] > 0.0)) {
+	fprintf(stderr, "The utilisations must be above 0, with the first one not above the last one and a step above 0.\n");
+	exit(-1);
+      }
+    }
+    else if ((strcmp(argv[counter], "--periods") == 0) && (counter + 1 < argc))
+      period_spec = argv[++counter];
+    else if ((strcmp(argv[counter], "--seed") == 0) && (counter + 1 < argc))
+      campaign_seed = strtoull(argv[++counter], NULL, 10);
+    else if ((strcmp(argv[counter], "-j") == 0) && (counter + 1 < argc)) {
+      threads = atoi(argv[++counter]);
+      if ((threads < 1) || (threads > MAX_WORKERS)) {
+	fprintf(stderr, "The number of threads must be between 1 and %d.\n", MAX_WORKERS);
+	exit(-1);
+      }
+    }
+    else if ((strcmp(argv[counter], "--watch") == 0) && (counter + 1 < argc))
+      watch_file = argv[++counter];
+    else if ((strcmp(argv[counter], "--only") == 0) && (counter + 1 < argc))
+      parse_selection(argv[++counter]);
+    else if ((strcmp(argv[counter], "--trace") == 0) && (counter + 1 < argc))
+      trace_open(argv[++counter]);
+    else if ((strcmp(argv[counter], "--compile") == 0) && (counter + 1 < argc))
+      model_output = argv[++counter];
+    else if ((strcmp(argv[counter], "--load") == 0) && (counter + 1 < argc))
+      model_input = argv[++counter];
+    else if ((strcmp(argv[counter], "--cache") == 0) && (counter + 1 < argc))
+      cache_directory = argv[++counter];
+    else if (strcmp(argv[counter], "--serve") == 0) {
+      serving = TRUE;
+      if ((counter + 1 < argc) && (argv[counter + 1][0] != '-'))
+	socket_name = argv[++counter];
+    }
+    else if (argv[counter][0] != '-')
+      contexts[no_models++].name = argv[counter];
+    else
+      usage();
+  }
+
+  if ((no_selected > 0) && (serving || verdicts_only || (campaign_sets > 0) || (model_output != NULL)))
+    usage();
+  if ((cache_directory != NULL) && (serving || (watch_file != NULL) || (campaign_sets > 0) || (model_output != NULL)))
+    usage();
+  if (serving) {
+    if (no_models > 0)
+      usage();
+    serve(socket_name);
+    return 0;
+  }
+
+  if (watch_file != NULL) {
+    if ((no_models > 0) || verdicts_only || assign_priorities || (no_selected > 0) ||
+	(campaign_sets > 0) || (model_input != NULL) || (model_output != NULL))
+      usage();
+    watch(watch_file);
+    return 0;
+  }
+
+  /* Several model files are parsed at the same time on the -j threads,
+     and then analysed one after the other */
+
+  if (((no_models > 0) && (model_input != NULL)) ||
+      ((no_models > 1) && ((model_output != NULL) || (campaign_sets > 0))))
+    usage();
+  if (model_input != NULL)
+    no_models = 1;
+  else if (no_models == 0) {
+    open_input(&contexts[0], NULL, stdin);
+    parse_model(&contexts[0]);
+    close_input(&contexts[0]);
+    no_models = 1;
+  }
+  else
+    parse_models(contexts, no_models, threads);
+
+  for (model = 0; model < no_models; model++) {
+    no_systems = initialise(&contexts[model]);
+    if (tracing)
+      for (current_system = 0; current_system < no_systems; current_system++)
+	trace_name(current_system, system_names[current_system]);
+
+    /* Just save the parsed model for later runs */
+
+    if (model_output != NULL) {
+      save_model(model_output, no_systems);
+      return 0;
+    }
+
+    if (campaign_sets > 0) {
+      campaign(0);
+      return 0;
     }
+
+    if (no_models > 1)
+      printf("\nModel `%s'\n", contexts[model].name);
+    if ((cache_directory != NULL) && cached_results(no_systems))
+      continue;
+    if (no_selected > 0)
+      select_cone(no_systems);
+    analyse(no_systems);
+
+    if (verdicts_only)
+      for (current_system = 0;current_system < no_systems;current_system++)
+	output_verdicts(current_system);
+    else if (!verbose && (no_selected > 0))
+      for (current_system = 0;current_system < no_systems;current_system++)
+	output_selection(current_system);
+    else if (!verbose)
+      for (current_system = 0;current_system < no_systems;current_system++)
+	output_results(current_system);
+
+    if (sensitivity_name != NULL)
+      for (current_system = 0; current_system < no_systems; current_system++)
+	if (check_variable(sensitivity_name, current_system))
+	  sensitivity(current_system, sensitivity_name);
+    if (cache_directory != NULL)
+      store_results();
   }
+  return 0;
+}
+
+/* ANALYSE
+
+   Runs the analysis of all systems until nothing changes any more.
+   Systems only affect each other through the global variables, so
+   after a system has been calculated, only the systems that read a
+   global it changed are calculated again, along with the system
+   itself if anything in it changed. The waiting systems are taken in
+   the order of system_dependencies, producers before consumers.
+   Systems that are already converged (kept by --watch) only wait if
+   a global they read changes.
+*/
 
-  no_systems = initialise();
+void analyse(int no_systems)
+{
+  int queued[MAX_SYSTEMS], deferred[MAX_SYSTEMS];
+  int current_system, consumer, variable;
+  unsigned long before;
+
+  if (assign_priorities)
+    for (current_system = 0; current_system < no_systems; current_system++)
+      audsley(current_system);
 
   if (verbose)
     output_variables(no_systems);
 
-  current_system = 0;
-  overall_change = TRUE;
+  /* With -s, systems that the sufficient tests decide completely
+     don't have to be iterated at all. */
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    if (verdicts_only)
+      decided[current_system] = prefilter(current_system);
+    else
+      decided[current_system] = FALSE;
+
+  system_dependencies(no_systems);
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    deferred[current_system] = (base_system[current_system] != INVALID) && !formula_writes(current_system, INVALID);
+    queued[current_system] = !decided[current_system] && !converged[current_system] && !deferred[current_system] &&
+      ((no_selected == 0) || system_needed[current_system]);
+  }
+
+  while ((current_system = next_system(queued, no_systems)) != INVALID) {
+    queued[current_system] = FALSE;
+    before = global_clock;
+    if (system_round(current_system))
+      queued[current_system] = TRUE;
+    if (global_clock != before)
+      for (consumer = 0; consumer < no_systems; consumer++)
+	if ((consumer != current_system) && !decided[consumer] && !deferred[consumer] &&
+	    ((no_selected == 0) || system_needed[consumer]))
+	  for (variable = 0; variable < no_global_variables; variable++)
+	    if (system_reads[consumer][variable] &&
+		((global_variable_versions[variable] > before) || (global_touched > before)))
+	      queued[consumer] = TRUE;
+  }
+  analyse_variants(no_systems, deferred);
+}
+
+/* SYSTEM_ROUND
+
+   Iterates the formulas of a system until they converge, with the
+   priority refreshes and the blocking they take. Returns TRUE if any
+   value changed.
+*/
+
+int system_round(int current_system)
+{
+  int change, restarts;
+  double round_start, start;
+
+  round_start = start = 0.0;
+  if (tracing)
+    round_start = trace_clock();
+  change = calculate_task_set(current_system);
+
+      /* Perform dynamic priority refreshing. After a fully converged calculation,
+	 check if the priorities have changed. If so, reset the system and
+	 calculate again with the new priorities. As long as it takes to ultra-
+	 mega-converge, or until the priorities come back to an assignment
+	 already seen in this round... */
+
+  restarts = 0;
+  no_refreshes[current_system] = 0;
+  if (priority_variable[current_system] != INVALID)
+    while (priority_refresh(current_system)) {
+      if (tracing)
+	start = trace_clock();
+      if (dynamic_blocking[current_system])
+	calculate_blocking(current_system);
+      change = change | calculate_task_set(current_system);
+      if (tracing)
+	trace_span("refresh", "priority refresh", NULL, current_system, start, ++restarts, NAN);
+    }
+  if (dynamic_blocking[current_system])
+    calculate_blocking(current_system);
+  if (tracing)
+    trace_span("round", system_names[current_system], NULL, current_system, round_start, restarts, NAN);
+  return(change);
+}
+
+/* ANALYSE_VARIANTS
+
+   Variants that write no global results depend on nothing the other
+   systems are still computing, so they are left out of the rounds and
+   analysed here, once the others have settled: side by side on the -j
+   threads, and starting from the results of their base when these are
+   known to be below their own (see warm_variant).
+*/
+
+void analyse_variants(int no_systems, int *deferred)
+{
+  struct variant_job job;
+  pthread_t workers[MAX_WORKERS];
+  int current_system, base, variable, task, no_workers, worker;
+
+  job.no_variants = 0;
+  for (current_system = 0; current_system < no_systems; current_system++)
+    if (deferred[current_system] && !decided[current_system] && !converged[current_system] &&
+	((no_selected == 0) || system_needed[current_system]))
+      job.variants[job.no_variants++] = current_system;
+  if (job.no_variants == 0)
+    return;
+
+  for (worker = 0; worker < job.no_variants; worker++) {
+    current_system = job.variants[worker];
+    base = base_system[current_system];
+    if (!warm_variant(current_system, deferred))
+      continue;
+    for (variable = 0; variable < no_vars[current_system]; variable++)
+      if (formula_writes(current_system, variable))
+	for (task = 0; task < ((variable_types[current_system][variable] == SCALAR_VAR) ? 1 : no_tasks[base]); task++)
+	  variables[current_system][variable][task] = max(variables[current_system][variable][task],
+							   variables[base][variable][task]);
+    touch_system(current_system);
+  }
+
+  no_workers = verbose ? 1 : ((threads < job.no_variants) ? threads : job.no_variants);
+  job.next_variant = 0;
+  job.side_by_side = (no_workers > 1);
+  pthread_mutex_init(&job.lock, NULL);
+  for (worker = 1; worker < no_workers; worker++)
+    if (pthread_create(&workers[worker], NULL, variant_worker, &job) != 0) {
+      fprintf(stderr, "Failed to start a variant thread.\n");
+      exit(-1);
+    }
+  variant_worker(&job);
+  for (worker = 1; worker < no_workers; worker++)
+    pthread_join(workers[worker], NULL);
+  pthread_mutex_destroy(&job.lock);
+}
+
+void *variant_worker(void *argument)
+{
+  struct variant_job *job;
+  int current_system;
+
+  job = argument;
+  side_by_side = job->side_by_side;
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    current_system = (job->next_variant < job->no_variants) ? job->variants[job->next_variant++] : INVALID;
+    pthread_mutex_unlock(&job->lock);
+    if (current_system == INVALID)
+      break;
+    while (system_round(current_system))
+      ;
+  }
+  return(NULL);
+}
+
+/* WARM_VARIANT
+
+   A variant can start from the converged results of its base when it
+   has the same formulas, its inputs have only grown (see grown), it
+   only adds tasks where no result can shrink with them, and its
+   results grow with each other (see monotone_system).
+*/
+
+int warm_variant(int current_system, int *deferred)
+{
+  int base, current_formula;
+  formula_t position;
+
+  base = base_system[current_system];
+  if (deferred[base] || (matrix_size[current_system] > 0) ||
+      (no_formulas[current_system] != no_formulas[base]))
+    return(FALSE);
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+    if (formulas[current_system][current_formula] != formulas[base][current_formula])
+      return(FALSE);
+  if (no_tasks[current_system] > no_tasks[base])
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+      for (position = formulas[current_system][current_formula]->next; position != NULL; position = position->next)
+	if ((position->field_type == OP_FIELD) && (position->func_field.op_field.operation == DIVIDE_OP))
+	  return(FALSE);
+  return(grown(current_system, backup_vars[base], no_tasks[base]) && monotone_system(current_system));
+}
+
+/* SYSTEM_DEPENDENCIES
 
-  while (overall_change || (current_system != 0)) {
-    if (current_system == 0)
-      overall_change = FALSE;
-    overall_change = overall_change | calculate_task_set(current_system);
+   Finds the global variables each system reads and writes, and ranks
+   the systems so that a system that writes a global comes before the
+   systems that read it. Systems in a cycle keep their declaration
+   order after the rest.
+*/
 
-    /* Perform dynamic priority refreshing. After a fully converged calculation,
-       check if the priorities have changed. If so, reset the system and
-       calculate again with the new priorities. As long as it takes to ultra-
-       mega-converge... */
+void system_dependencies(int no_systems)
+{
+  int writes[MAX_SYSTEMS][MAX_VARIABLES], ranked[MAX_SYSTEMS];
+  int current_system, producer, current_formula, read, variable, rank, ready;
+  char *result_var_name;
+
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    for (variable = 0; variable < no_global_variables; variable++)
+      system_reads[current_system][variable] = writes[current_system][variable] = FALSE;
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      result_var_name = result_name(formulas[current_system][current_formula], current_system);
+      if (!check_variable(result_var_name, current_system))
+	writes[current_system][get_global_variable_index(result_var_name)] = TRUE;
+      if (reads[current_system][current_formula].untracked)
+	for (variable = 0; variable < no_global_variables; variable++)
+	  system_reads[current_system][variable] = TRUE;
+      for (read = 0; read < reads[current_system][current_formula].no_reads; read++)
+	if (reads[current_system][current_formula].global[read])
+	  system_reads[current_system][reads[current_system][current_formula].variable[read]] = TRUE;
+    }
+    ranked[current_system] = FALSE;
+  }
 
-    if (priority_variable[current_system] != INVALID)
-      while (priority_refresh(current_system)) {
-	if (dynamic_blocking[current_system])
-	  calculate_blocking(current_system);
-        overall_change = overall_change | calculate_task_set(current_system);
+  /* A system is ready when all other systems writing what it reads
+     have been ranked */
+
+  rank = 0;
+  do {
+    ready = INVALID;
+    for (current_system = 0; (current_system < no_systems) && (ready == INVALID); current_system++)
+      if (!ranked[current_system]) {
+	ready = current_system;
+	for (producer = 0; producer < no_systems; producer++)
+	  if ((producer != current_system) && !ranked[producer])
+	    for (variable = 0; variable < no_global_variables; variable++)
+	      if (writes[producer][variable] && system_reads[current_system][variable])
+		ready = INVALID;
       }
-    if (dynamic_blocking[current_system])
-      calculate_blocking(current_system);
+    if (ready != INVALID) {
+      ranked[ready] = TRUE;
+      system_rank[ready] = rank++;
+    }
+  } while (ready != INVALID);
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    if (!ranked[current_system])
+      system_rank[current_system] = rank++;
+}
 
-    if (++current_system == no_systems)
-      current_system = 0;
+/* Returns the waiting system with the lowest rank, or INVALID */
+
+int next_system(int *queued, int no_systems)
+{
+  int current_system, next;
+
+  next = INVALID;
+  for (current_system = 0; current_system < no_systems; current_system++)
+    if (queued[current_system] && ((next == INVALID) || (system_rank[current_system] < system_rank[next])))
+      next = current_system;
+  return(next);
+}
+
+/* PARSE_SELECTION
+
+   Reads the elements given with --only, like R[t1],R[t2],U. A variable
+   without a task selects all its elements.
+*/
+
+void parse_selection(char *spec)
+{
+  char *position;
+  int length;
+
+  position = spec;
+  while (*position != '\0') {
+    if (no_selected == MAX_SELECTED) {
+      fprintf(stderr, "At most %d elements can be selected with --only.\n", MAX_SELECTED);
+      exit(-1);
+    }
+    length = strcspn(position, "[,");
+    if ((length == 0) || (length >= STRING_SIZE)) {
+      fprintf(stderr, "Malformed --only selection `%s'.\n", spec);
+      exit(-1);
+    }
+    strncpy(selected_variables[no_selected], position, length);
+    selected_variables[no_selected][length] = '\0';
+    position += length;
+    selected_tasks[no_selected][0] = '\0';
+    if (*position == '[') {
+      length = strcspn(++position, "]");
+      if ((position[length] != ']') || (length == 0) || (length >= STRING_SIZE)) {
+	fprintf(stderr, "Malformed --only selection `%s'.\n", spec);
+	exit(-1);
+      }
+      strncpy(selected_tasks[no_selected], position, length);
+      selected_tasks[no_selected][length] = '\0';
+      position += length + 1;
+    }
+    no_selected++;
+    if (*position == ',')
+      position++;
+    else if (*position != '\0') {
+      fprintf(stderr, "Malformed --only selection `%s'.\n", spec);
+      exit(-1);
+    }
   }
+}
 
-  if (!verbose)
-    for (current_system = 0;current_system < no_systems;current_system++) {
-      printf("\n\nSystem '%s'\n", system_names[current_system]);
-      printf("-------------------\n");
-      for (current_formula = 0;current_formula < no_formulas[current_system];current_formula++) {
-	strcpy(result_var_name, formulas[current_system][current_formula]->func_field.definition.result_variable);
-	if (check_variable(result_var_name, current_system)) {
-	  result_var_index = get_variable_index(result_var_name, current_system);
-	  result_var_type = variable_types[current_system][result_var_index];
-	  scalar_result = variables[current_system][result_var_index][0];
+/* SELECT_CONE
+
+   For --only: marks the elements the selection depends on, following
+   the reads of the formulas backwards, within a system and through the
+   global variables across systems, until nothing new is found. Only the
+   formula elements marked in 'needed' are evaluated, and only in the
+   systems in 'system_needed'. The blocking factors depend on all the
+   priorities through calculate_blocking.
+*/
+
+void select_cone(int no_systems)
+{
+  struct formula_reads *formula_reads;
+  char *result_var_name;
+  int current_system, current_formula, selection, variable, task, type, global_result, result_var_index,
+  read, first_task, last_task, change, found;
+
+  memset(wanted, 0, sizeof(wanted));
+  memset(global_wanted, 0, sizeof(global_wanted));
+  memset(needed, 0, sizeof(needed));
+  for (current_system = 0; current_system < no_systems; current_system++)
+    system_needed[current_system] = FALSE;
+
+  for (selection = 0; selection < no_selected; selection++) {
+    found = FALSE;
+    for (current_system = 0; current_system < no_systems; current_system++)
+      if (check_variable(selected_variables[selection], current_system)) {
+	task = INVALID;
+	if (selected_tasks[selection][0] != '\0') {
+	  if (!check_task(selected_tasks[selection], current_system))
+	    continue;
+	  task = get_task_index(selected_tasks[selection], current_system);
 	}
-	else {
+	want(current_system, FALSE, get_variable_index(selected_variables[selection], current_system), task);
+	found = TRUE;
+      }
+    if (check_global_variable(selected_variables[selection]) &&
+	((selected_tasks[selection][0] == '\0') || check_global_task(selected_tasks[selection]))) {
+      task = INVALID;
+      if (selected_tasks[selection][0] != '\0')
+	task = get_global_task_index(selected_tasks[selection]);
+      want(0, TRUE, get_global_variable_index(selected_variables[selection]), task);
+      found = TRUE;
+    }
+    if (!found) {
+      fprintf(stderr, "`%s%s%s%s' in --only is not an element of the model.\n", selected_variables[selection],
+	      (selected_tasks[selection][0] != '\0') ? "[" : "", selected_tasks[selection],
+	      (selected_tasks[selection][0] != '\0') ? "]" : "");
+      exit(-1);
+    }
+  }
+
+  do {
+    change = FALSE;
+    for (current_system = 0; current_system < no_systems; current_system++) {
+      if ((blocking_variable[current_system] != INVALID) && (priority_variable[current_system] != INVALID))
+	for (task = 0; task < no_tasks[current_system]; task++)
+	  if (wanted[current_system][blocking_variable[current_system]][task]) {
+	    change |= want(current_system, FALSE, priority_variable[current_system], INVALID);
+	    break;
+	  }
+
+      for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+	result_var_name = result_name(formulas[current_system][current_formula], current_system);
+	global_result = !check_variable(result_var_name, current_system);
+	if (global_result)
 	  result_var_index = get_global_variable_index(result_var_name);
-	  result_var_type = global_variable_types[result_var_index];
-	  scalar_result = global_variables[result_var_index][0];
+	else
+	  result_var_index = get_variable_index(result_var_name, current_system);
+	type = formulas[current_system][current_formula]->func_field.definition.index_type;
+	if (type == SINGLE_INDEX) {
+	  if (global_result)
+	    first_task = get_global_task_index(result_task(formulas[current_system][current_formula], current_system));
+	  else
+	    first_task = get_task_index(result_task(formulas[current_system][current_formula], current_system), current_system);
+	  last_task = first_task;
 	}
+	else if (type == I_INDEX) {
+	  first_task = 0;
+	  last_task = (global_result ? no_global_tasks : no_tasks[current_system]) - 1;
+	}
+	else
+	  first_task = last_task = 0;
+
+	for (task = first_task; task <= last_task; task++) {
+	  if (needed[current_system][current_formula][task] ||
+	      !(global_result ? global_wanted[result_var_index][task] : wanted[current_system][result_var_index][task]))
+	    continue;
+	  needed[current_system][current_formula][task] = TRUE;
+	  system_needed[current_system] = TRUE;
+	  change = TRUE;
+
+	  formula_reads = &reads[current_system][current_formula];
+	  if (formula_reads->untracked) {
+	    for (variable = 0; variable < no_vars[current_system]; variable++)
+	      want(current_system, FALSE, variable, INVALID);
+	    for (variable = 0; variable < no_global_variables; variable++)
+	      want(current_system, TRUE, variable, INVALID);
+	    continue;
+	  }
 
-	printf("\n");
+	  /* The tasks of a global variable read by `i' are matched by
+	     name, so all of them are taken */
 
-	if (result_var_type == INDEXED_VAR) {
-	  if (check_variable(result_var_name, current_system)) {
-	    for (current_index = 0;current_index < no_tasks[current_system];current_index++)
-	      printf("%s[%s] = %f\n", result_var_name, task_names[current_system][current_index], variables[current_system][result_var_index][current_index]);
-	  }
-	  else {
-	    for (current_index = 0;current_index < no_global_tasks; current_index++)
-	      printf("%s[%s] = %f\n", result_var_name, global_task_names[current_index], global_variables[result_var_index][current_index]);
-	  }
+	  for (read = 0; read < formula_reads->no_reads; read++)
+	    if (formula_reads->index_type[read] == SINGLE_INDEX)
+	      want(current_system, formula_reads->global[read], formula_reads->variable[read], formula_reads->task[read]);
+	    else if ((formula_reads->index_type[read] == I_INDEX) && !formula_reads->global[read])
+	      want(current_system, FALSE, formula_reads->variable[read], task);
+	    else
+	      want(current_system, formula_reads->global[read], formula_reads->variable[read], INVALID);
 	}
-	else
-	  printf("%s = %f\n", result_var_name, scalar_result);
       }
     }
-    return 0;
+  } while (change);
+}
+
+/* Marks an element as wanted, or all of them if 'task' is INVALID, and
+   returns TRUE if any of them wasn't already */
+
+int want(int current_system, int global, int variable, int task)
+{
+  char *marks;
+  int no_elements, counter, change;
+
+  if (global) {
+    marks = global_wanted[variable];
+    no_elements = (global_variable_types[variable] == SCALAR_VAR) ? 1 : no_global_tasks;
+  }
+  else {
+    marks = wanted[current_system][variable];
+    no_elements = (variable_types[current_system][variable] == SCALAR_VAR) ? 1 : no_tasks[current_system];
+  }
+  if (no_elements == 1)
+    task = 0;
+
+  change = FALSE;
+  for (counter = 0; counter < no_elements; counter++)
+    if (((task == INVALID) || (counter == task)) && !marks[counter]) {
+      marks[counter] = TRUE;
+      change = TRUE;
+    }
+  return(change);
+}
+
+void usage(void)
+{
+  fprintf(stderr, "Usage: fpscalc [-v] [-s] [-a] [-p] [-j threads] [--only var[task],...] [--sensitivity variable]\n"
+	  "       [--campaign sets [--utilisation from:to:step] [--periods min:max | list] [--seed n]] [--trace file]\n"
+	  "       [--compile file | --load file] [--serve [socket]] [--cache directory]\n"
+	  "       [--watch file | file ...]\n");
+  exit(-1);
+}
+
+/* OUTPUT_RESULTS
+
+   Prints the result variables of all formulas of a system
+*/
+
+void output_results(int current_system)
+{
+  int current_formula,
+  current_index,
+  result_var_index,
+  result_var_type;
+  char result_var_name[STRING_SIZE];
+  double scalar_result;
+
+  printf("\n\nSystem '%s'\n", system_names[current_system]);
+  printf("-------------------\n");
+  for (current_formula = 0;current_formula < no_formulas[current_system];current_formula++) {
+    strcpy(result_var_name, result_name(formulas[current_system][current_formula], current_system));
+    if (check_variable(result_var_name, current_system)) {
+      result_var_index = get_variable_index(result_var_name, current_system);
+      result_var_type = variable_types[current_system][result_var_index];
+      scalar_result = variables[current_system][result_var_index][0];
+    }
+    else {
+      result_var_index = get_global_variable_index(result_var_name);
+      result_var_type = global_variable_types[result_var_index];
+      scalar_result = global_variables[result_var_index][0];
+    }
+
+    printf("\n");
+
+    if (result_var_type == MATRIX_VAR)
+      output_matrix(current_system, result_var_index, 0, no_tasks[current_system] - 1);
+    else if (result_var_type == INDEXED_VAR) {
+      if (check_variable(result_var_name, current_system)) {
+	for (current_index = 0;current_index < no_tasks[current_system];current_index++)
+	  printf("%s[%s] = %f\n", result_var_name, task_names[current_system][current_index], variables[current_system][result_var_index][current_index]);
+      }
+      else {
+	for (current_index = 0;current_index < no_global_tasks; current_index++)
+	  printf("%s[%s] = %f\n", result_var_name, global_task_names[current_index], global_variables[result_var_index][current_index]);
+      }
+    }
+    else
+      printf("%s = %f\n", result_var_name, scalar_result);
+  }
+}
+
+/* Prints the elements of the given rows of a matrix */
+
+void output_matrix(int current_system, int variable, int first_row, int last_row)
+{
+  int row, column;
+
+  for (row = first_row; row <= last_row; row++)
+    for (column = 0; column < no_tasks[current_system]; column++)
+      printf("%s[%s][%s] = %f\n", variable_names[current_system][variable], task_names[current_system][row], task_names[current_system][column],
+	     matrix_elements[current_system][matrix_offset[current_system][variable] + row * no_tasks[current_system] + column]);
+}
+
+/* OUTPUT_SELECTION
+
+   Prints the elements selected with --only, in the form of
+   output_results. A global variable is printed with the systems that
+   have a formula for it.
+*/
+
+void output_selection(int current_system)
+{
+  int selection, variable, task, last_task, current_formula, global, shown;
+  char *name;
+
+  shown = FALSE;
+  for (selection = 0; selection < no_selected; selection++) {
+    name = selected_variables[selection];
+    if (check_variable(name, current_system)) {
+      global = FALSE;
+      variable = get_variable_index(name, current_system);
+    }
+    else if (check_global_variable(name)) {
+      global = TRUE;
+      variable = get_global_variable_index(name);
+      for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+	if (strcmp(result_name(formulas[current_system][current_formula], current_system), name) == 0)
+	  break;
+      if (current_formula == no_formulas[current_system])
+	continue;
+    }
+    else
+      continue;
+
+    task = 0;
+    last_task = (global ? no_global_tasks : no_tasks[current_system]) - 1;
+    if (selected_tasks[selection][0] != '\0') {
+      if (global ? !check_global_task(selected_tasks[selection]) : !check_task(selected_tasks[selection], current_system))
+	continue;
+      task = last_task = global ? get_global_task_index(selected_tasks[selection]) : get_task_index(selected_tasks[selection], current_system);
+    }
+
+    if (!shown) {
+      printf("\n\nSystem '%s'\n", system_names[current_system]);
+      printf("-------------------\n");
+      shown = TRUE;
+    }
+    printf("\n");
+    if ((global ? global_variable_types[variable] : variable_types[current_system][variable]) == SCALAR_VAR)
+      printf("%s = %f\n", name, global ? global_variables[variable][0] : variables[current_system][variable][0]);
+    else if (!global && (variable_types[current_system][variable] == MATRIX_VAR))
+      output_matrix(current_system, variable, task, last_task);
+    else
+      for (; task <= last_task; task++)
+	if (global)
+	  printf("%s[%s] = %f\n", name, global_task_names[task], global_variables[variable][task]);
+	else
+	  printf("%s[%s] = %f\n", name, task_names[current_system][task], variables[current_system][variable][task]);
+  }
 }
 
 /* CALCULATE_TASK
@@ -249,74 +1426,235 @@ int calculate_task_set(int current_system)
   first_iteration,
   current_formula,
   change,
-  overall_change;
-  double last_result, latest_result;
+  overall_change,
+  one_task,
+  matrix_result,
+  position,
+  first,
+  report,
+  iterations,
+  affine_step,
+  diverging;
+  double last_result, latest_result, start_value;
+  double formula_start, element_start, iteration_start;
   char result_var_name[STRING_SIZE];
+  char *trace_task;
 
   current_formula = 0;
   change = TRUE;
   overall_change = FALSE;
+  formula_start = element_start = iteration_start = start_value = 0.0;
+  trace_task = NULL;
+  report = verbose && (current_system < MAX_SYSTEMS);
+  if (only_task[current_system] == INVALID)
+    evaluation_order(current_system);
 
   if (no_formulas[current_system] > 0) {
     while (change || (current_formula != 0))  {
       if (current_formula == 0)
       change = FALSE;
 
-      strcpy(result_var_name, formulas[current_system][current_formula]->func_field.definition.result_variable);
+      strcpy(result_var_name, result_name(formulas[current_system][current_formula], current_system));
 
       if (check_variable(result_var_name, current_system)) {
 	result_var_index = get_variable_index(result_var_name, current_system);
 	global_result_var = FALSE;
 	no_result_tasks = no_tasks[current_system];
+	matrix_result = (variable_types[current_system][result_var_index] == MATRIX_VAR);
       }
       else {
 	result_var_index = get_global_variable_index(result_var_name);
 	global_result_var = TRUE;
 	no_result_tasks = no_global_tasks;
+	matrix_result = FALSE;
       }
 
       type = formulas[current_system][current_formula]->func_field.definition.index_type;
       if (type == SINGLE_INDEX) {
 	if (global_result_var)
-	  counter = get_global_task_index(formulas[current_system][current_formula]->func_field.definition.result_index_task);
+	  counter = get_global_task_index(result_task(formulas[current_system][current_formula], current_system));
 	else
-	  counter = get_task_index(formulas[current_system][current_formula]->func_field.definition.result_index_task, current_system);
+	  counter = get_task_index(result_task(formulas[current_system][current_formula], current_system), current_system);
       }
       else
 	counter = 0;
       /* Scalar variables are stored in field 0 of the variable array. */
 
+      /* A scratch system may be restricted to the elements of one task,
+	 but other rows of a matrix may be read by them */
+
+      one_task = (type == I_INDEX) && !global_result_var && !matrix_result && (only_task[current_system] != INVALID);
+      if (one_task)
+	counter = only_task[current_system];
+      position = 0;
+      if (tracing)
+	formula_start = trace_clock();
+
       do {
-	first_iteration = TRUE;
+	/* task_order is not kept for a scratch system restricted to one task */
+
+	if ((type == I_INDEX) && !one_task)
+	  counter = (global_result_var || (only_task[current_system] != INVALID)) ? position : task_order[current_system][position];
+	first = ((type == I_INDEX) && !one_task) ? (position == 0) : (counter == 0);
+
+	/* With --only, the elements outside the selection's cone are left alone */
+
+	if ((no_selected > 0) && (current_system < MAX_SYSTEMS) && !needed[current_system][current_formula][counter])
+	  continue;
+
+	/* A matrix formula gives a row of elements for each task */
+
+	if (matrix_result) {
+	  if (needs_evaluation(current_system, current_formula, counter)) {
+	    if (tracing)
+	      element_start = trace_clock();
+	    if (evaluate_row(current_system, current_formula, result_var_index, counter) && (current_formula != 0))
+	      overall_change = change = TRUE;
+	    if (tracing)
+	      trace_span("element", result_name(formulas[current_system][current_formula], current_system),
+			 task_names[current_system][counter], current_system, element_start, NO_COUNT, NAN);
+	  }
+	  evaluated[current_system][current_formula][counter] = clock_ticks[current_system];
+	  global_evaluated[current_system][current_formula][counter] = global_clock;
+	  if (report && first)
+	    printf("\nSystem `%s'\n------------------\n\n", system_names[current_system]);
+	  if (report)
+	    output_matrix(current_system, result_var_index, counter, counter);
+	  continue;
+	}
+
+	/* Nothing to do if none of the inputs changed since the last time */
+
+	first_iteration = needs_evaluation(current_system, current_formula, counter);
+	if (global_result_var)
+	  last_result = latest_result = global_variables[result_var_index][counter];
+	else
+	  last_result = latest_result = variables[current_system][result_var_index][counter];
+	if (tracing) {
+	  element_start = trace_clock();
+	  if (type == SCALAR)
+	    trace_task = NULL;
+	  else
+	    trace_task = global_result_var ? global_task_names[counter] : task_names[current_system][counter];
+	}
+	iterations = affine_step = 0;
+	diverging = FALSE;
 	while ((first_iteration) || (last_result != latest_result)) {
 	  first_iteration = FALSE;
+	  iterations++;
+	  if (tracing)
+	    iteration_start = trace_clock();
 	  if (global_result_var) {
 	    last_result = global_variables[result_var_index][counter];
-	    latest_result = global_variables[result_var_index][counter] = parse_rpn(formulas[current_system][current_formula], counter, 0 , current_system, GLOBAL_RESULT);
+	    latest_result = parse_rpn(formulas[current_system][current_formula], counter, INVALID, INVALID, current_system, GLOBAL_RESULT);
+	    set_global_element(result_var_index, counter, latest_result);
 	  }
 	  else {
 	    last_result = variables[current_system][result_var_index][counter];
-	    latest_result = variables[current_system][result_var_index][counter] = parse_rpn(formulas[current_system][current_formula], counter, 0, current_system, LOCAL_RESULT);
-	  }
-
+	    latest_result = evaluate_formula(current_system, current_formula, counter, LOCAL_RESULT);
+
+	    /* An affine formula goes straight to its fixed point after two
+	       steps, and is then only evaluated again to confirm it. The
+	       solution is rounded, and iterating from it could go back and
+	       forth between neighbouring values for ever, so it is kept if
+	       the confirmation is within a few ulps, and solved again from
+	       there if not. */
+
+	    if (affine[current_system][current_formula])
+	      switch (++affine_step) {
+	      case 1:
+		start_value = last_result;
+		break;
+	      case 2:
+		if (latest_result != last_result) {
+		  latest_result = affine_solution(start_value, last_result, latest_result);
+		  diverging = (latest_result == HUGE_VAL);
+		}
+		break;
+	      default:
+		if (fabs(latest_result - last_result) <= AFFINE_ULPS * DBL_EPSILON * max(fabs(latest_result), fabs(last_result)))
+		  latest_result = last_result;
+		else {
+		  start_value = last_result;
+		  affine_step = 1;
+		}
+	      }
+
+	    /* A response time recurrence skips the steps that can't get
+	       to a fixed point */
+
+	    if ((kernels[current_system][current_formula] != NULL) && kernels[current_system][current_formula]->jump &&
+		(latest_result > last_result))
+	      latest_result = rta_jump(kernels[current_system][current_formula], counter, current_system, last_result, latest_result);
+	    set_element(current_system, result_var_index, counter, latest_result);
+	  }
+	  if (tracing)
+	    trace_span("iteration", result_name(formulas[current_system][current_formula], current_system),
+		       trace_task, current_system, iteration_start, iterations, latest_result);
+
 	  if ((last_result != latest_result) && (current_formula != 0))
 	    overall_change = change = TRUE;
+
+	  /* Give up as soon as the response time passes the deadline, if
+	     that's all we want to know */
+
+	  if (!global_result_var && (result_var_index == cutoff_variable[current_system]) &&
+	      ((cutoff_task[current_system] == INVALID) || (counter == cutoff_task[current_system])) &&
+	      (latest_result > variables[current_system][cutoff_limit[current_system]][counter])) {
+	    deadline_missed[current_system] = TRUE;
+	    if (tracing) {
+	      trace_span("element", result_name(formulas[current_system][current_formula], current_system),
+			 trace_task, current_system, element_start, iterations, latest_result);
+	      trace_span("formula", result_name(formulas[current_system][current_formula], current_system),
+			 NULL, current_system, formula_start, NO_COUNT, NAN);
+	    }
+	    return(overall_change);
+	  }
+
+	  /* Without a fixed point, the element is left at infinity. With a
+	     cutoff, the system is overloaded, which counts as a deadline
+	     passed. Otherwise only -s and --watch go on with it. */
+
+	  if (diverging) {
+	    if (cutoff_variable[current_system] != INVALID) {
+	      deadline_missed[current_system] = TRUE;
+	      if (tracing) {
+		trace_span("element", result_name(formulas[current_system][current_formula], current_system),
+			   trace_task, current_system, element_start, iterations, latest_result);
+		trace_span("formula", result_name(formulas[current_system][current_formula], current_system),
+			   NULL, current_system, formula_start, NO_COUNT, NAN);
+	      }
+	      return(overall_change);
+	    }
+	    report_divergence(current_system, current_formula, counter);
+	    if (!verdicts_only && !watching)
+	      exit(-1);
+	    break;
+	  }
 	}
+	if (tracing && (iterations > 0))
+	  trace_span("element", result_name(formulas[current_system][current_formula], current_system),
+		     trace_task, current_system, element_start, iterations, latest_result);
+	evaluated[current_system][current_formula][counter] = clock_ticks[current_system];
+	global_evaluated[current_system][current_formula][counter] = global_clock;
 
 	/* If in verbose mode, output the results after each convergion */
 
-	if (verbose && (counter == 0))
+	if (report && first)
 	  printf("\nSystem `%s'\n------------------\n\n", system_names[current_system]);
-	if (verbose && (type == SCALAR) && (counter == 0))
+	if (report && (type == SCALAR) && first)
 	  printf("%s = %f\n", result_var_name, last_result);
-	else if (verbose) {
+	else if (report) {
 	  if (global_result_var)
 	    printf("%s[%s] = %f\n", result_var_name, global_task_names[counter], global_variables[result_var_index][counter]);
 	  else
 	    printf("%s[%s] = %f\n", result_var_name, task_names[current_system][counter], variables[current_system][result_var_index][counter]);
 	}
 
-      } while ((type == I_INDEX) && (++counter < no_result_tasks));
+      } while ((type == I_INDEX) && !one_task && (++position < no_result_tasks));
+      if (tracing)
+	trace_span("formula", result_name(formulas[current_system][current_formula], current_system),
+		   NULL, current_system, formula_start, NO_COUNT, NAN);
       if (++current_formula == no_formulas[current_system])
 	current_formula = 0;
     }
@@ -324,22 +1662,47 @@ int calculate_task_set(int current_system)
   return(overall_change);
 }
 
+/* EVALUATE_ROW
+
+   Evaluates a matrix formula for the elements of row index_i, each
+   until it doesn't change any more. Returns TRUE if any of them
+   changed.
+*/
+
+int evaluate_row(int current_system, int current_formula, int variable, int index_i)
+{
+  int index_j, changed;
+  double last_result, latest_result;
+
+  changed = FALSE;
+  for (index_j = 0; index_j < no_tasks[current_system]; index_j++)
+    do {
+      last_result = matrix_elements[current_system][matrix_offset[current_system][variable] + index_i * no_tasks[current_system] + index_j];
+      latest_result = parse_rpn(formulas[current_system][current_formula], index_i, index_j, INVALID, current_system, LOCAL_RESULT);
+      set_matrix_element(current_system, variable, index_i, index_j, latest_result);
+      if (last_result != latest_result)
+	changed = TRUE;
+    } while (last_result != latest_result);
+  return(changed);
+}
+
 /* PARSE_RPN
 
    This function evaluates a formula according to Reverse Polish Notation
-   and returns a numerical value as its result
+   and returns a numerical value as its result. index_j is INVALID
+   outside summations, and index_k outside nested summations.
 */
 
 double parse_rpn(formula_t position,
 		 int index_i,
 		 int index_j,
+		 int index_k,
 		 int current_system,
 		 int result_type)
 {
   formula_t current_position;
-  int current_var, direct_index, stop_parsing;
+  int current_var, direct_index, stop_parsing, index, variable, global;
   double carry;
-  char var_name[STRING_SIZE];
 
   current_var = INVALID;
   direct_index = FALSE;
@@ -360,28 +1723,28 @@ double parse_rpn(formula_t position,
 	case OP_FIELD :
 	  switch (current_position->func_field.op_field.operation)
 	    {
-	    case MINUS :
+	    case MINUS_OP :
 	      carry = pop(current_system);
 	      push(pop(current_system) - carry, current_system);
 	      break;
 
-	    case PLUS :
+	    case PLUS_OP :
 	      push(pop(current_system) + pop(current_system), current_system);
 	      break;
 
-	    case MAX :
+	    case MAX_OP :
 	      push(max(pop(current_system), pop(current_system)), current_system);
 	      break;
 
-	    case MIN :
+	    case MIN_OP :
 	      push(min(pop(current_system), pop(current_system)), current_system);
 	      break;
 
-	    case MULTIPLY :
+	    case MULTIPLY_OP :
 	      push(pop(current_system) * pop(current_system), current_system);
 	      break;
 
-	    case DIVIDE :
+	    case DIVIDE_OP :
 	      carry = pop(current_system);
 	      if (carry == 0.0) {
 		fprintf(stderr, "Division by zero error in system `%s'.\n", system_names[current_system]);
@@ -390,106 +1753,100 @@ double parse_rpn(formula_t position,
 	      push(pop(current_system) / carry, current_system);
 	      break;
 
-	    case UMINUS :
+	    case UMINUS_OP :
 	      push(-pop(current_system), current_system);
 	      break;
 
-	    case CEILING :
+	    case CEILING_OP :
 	      push(ceil(pop(current_system)), current_system);
 	      break;
 
-	    case FLOOR :
+	    case FLOOR_OP :
 	      push(floor(pop(current_system)), current_system);
 	      break;
 
-	    case SIGMA_HP :
-	      push(sigma_hp(current_position, index_i, current_system, result_type), current_system);
-	      do {
-		current_position = current_position->next;
-		while (current_position->field_type != OP_FIELD)
-		  current_position = current_position->next;
-	      } while (current_position->func_field.op_field.operation != END_SIGMA);
+	    case SIGMA_HP_OP :
+	      push(sigma_hp(current_position, index_i, index_j, current_system, result_type), current_system);
+	      current_position = end_of_sigma(current_position);
 	      break;
 
-	    case SIGMA_LP :
-	      push(sigma_lp(current_position, index_i, current_system, result_type), current_system);
-	      do {
-		current_position = current_position->next;
-		while (current_position->field_type != OP_FIELD)
-		  current_position = current_position->next;
-	      } while (current_position->func_field.op_field.operation != END_SIGMA);
+	    case SIGMA_LP_OP :
+	      push(sigma_lp(current_position, index_i, index_j, current_system, result_type), current_system);
+	      current_position = end_of_sigma(current_position);
 	      break;
 
-	    case SIGMA_EP :
-	      push(sigma_ep(current_position, index_i, current_system, result_type), current_system);
-	      do {
-		current_position = current_position->next;
-		while (current_position->field_type != OP_FIELD)
-		  current_position = current_position->next;
-	      } while (current_position->func_field.op_field.operation != END_SIGMA);
+	    case SIGMA_EP_OP :
+	      push(sigma_ep(current_position, index_i, index_j, current_system, result_type), current_system);
+	      current_position = end_of_sigma(current_position);
 	      break;
 
-	    case SIGMA_ALL :
-	      push(sigma_all(current_position, index_i, current_system, result_type), current_system);
-	      do {
-		current_position = current_position->next;
-		while (current_position->field_type != OP_FIELD)
-		  current_position = current_position->next;
-	      } while (current_position->func_field.op_field.operation != END_SIGMA);
+	    case SIGMA_ALL_OP :
+	      push(sigma_all(current_position, index_i, index_j, current_system, result_type), current_system);
+	      current_position = end_of_sigma(current_position);
 	      break;
 
-	    case END_SIGMA :
+	    case END_SIGMA_OP :
 	      stop_parsing = TRUE; /* Return to the calling sigma function! */
 	      break;
 	    }
 	  break;
 
 	case VAR_FIELD :
-	  strcpy(var_name, current_position->func_field.op_field.var_field.variable_name);
+	  if (current_position->func_field.op_field.var_field.column_type != INVALID) {
+	    push(matrix_element(current_position, index_i, index_j, index_k, current_system, result_type), current_system);
+	    break;
+	  }
+	  variable = current_position->func_field.op_field.var_field.variable;
+	  global = current_position->func_field.op_field.var_field.global;
 	  switch (current_position->func_field.op_field.var_field.index_type)
 	    {
 	    case SCALAR :
-	      if (check_variable(var_name, current_system))
-		push(variables[current_system][get_variable_index(var_name, current_system)][0], current_system);
+	      if (!global)
+		push(variables[current_system][variable][0], current_system);
 	      else
-		push(global_variables[get_global_variable_index(var_name)][0], current_system);
+		push(global_variables[variable][0], current_system);
 	      break;
 
 	    case SINGLE_INDEX :
-	      if (check_variable(var_name, current_system))
-		push(variables[current_system][get_variable_index(var_name, current_system)][get_task_index(current_position->func_field.op_field.var_field.variable_index_task, current_system)], current_system);
+	      if (!global)
+		push(variables[current_system][variable][current_position->func_field.op_field.var_field.task], current_system);
 	      else
-		push(global_variables[get_global_variable_index(var_name)][get_global_task_index(current_position->func_field.op_field.var_field.variable_index_task)], current_system);
+		push(global_variables[variable][current_position->func_field.op_field.var_field.task], current_system);
 
 	      break;
 
 	    case I_INDEX :
-	      if (check_variable(var_name, current_system)) {
+	      if (!global) {
 		if (result_type == GLOBAL_RESULT)
-		  push(variables[current_system][get_variable_index(var_name, current_system)][get_task_index(global_task_names[index_i], current_system)], current_system);
+		  push(variables[current_system][variable][get_task_index(global_task_names[index_i], current_system)], current_system);
 		else
-		  push(variables[current_system][get_variable_index(var_name, current_system)][index_i], current_system);
+		  push(variables[current_system][variable][index_i], current_system);
 	      }
 	      else {
 		if (result_type == GLOBAL_RESULT)
-		  push(global_variables[get_global_variable_index(var_name)][index_i], current_system);
+		  push(global_variables[variable][index_i], current_system);
 		else
-		  push(global_variables[get_global_variable_index(var_name)][get_global_task_index(task_names[current_system][index_i])], current_system);
+		  push(global_variables[variable][get_global_task_index(task_names[current_system][index_i])], current_system);
 	      }
 	      break;
 
 	    case J_INDEX :
-	      if (check_variable(var_name, current_system)) {
+	    case K_INDEX :
+	      if (current_position->func_field.op_field.var_field.index_type == J_INDEX)
+		index = index_j;
+	      else
+		index = index_k;
+	      if (!global) {
 		if (result_type == GLOBAL_RESULT)
-		  push(variables[current_system][get_variable_index(var_name, current_system)][get_task_index(global_task_names[index_j], current_system)], current_system);
+		  push(variables[current_system][variable][get_task_index(global_task_names[index], current_system)], current_system);
 		else
-		  push(variables[current_system][get_variable_index(var_name, current_system)][index_j], current_system);
+		  push(variables[current_system][variable][index], current_system);
 	      }
 	      else {
 		if (result_type == GLOBAL_RESULT)
-		  push(global_variables[get_global_variable_index(var_name)][index_j], current_system);
+		  push(global_variables[variable][index], current_system);
 		else
-		  push(global_variables[get_global_variable_index(var_name)][get_global_task_index(task_names[current_system][index_j])], current_system);
+		  push(global_variables[variable][get_global_task_index(task_names[current_system][index])], current_system);
 	      }
 	      break;
 	    }
@@ -500,161 +1857,4448 @@ double parse_rpn(formula_t position,
   return(pop(current_system));
 }
 
+/* MATRIX_ELEMENT
+
+   Returns the element of a (local) matrix read by a formula field
+*/
+
+double matrix_element(formula_t position, int index_i, int index_j, int index_k, int current_system, int result_type)
+{
+  int variable, row, column;
+
+  variable = position->func_field.op_field.var_field.variable;
+  row = field_task(position->func_field.op_field.var_field.index_type, position->func_field.op_field.var_field.task,
+		   index_i, index_j, index_k, current_system, result_type);
+  column = field_task(position->func_field.op_field.var_field.column_type, position->func_field.op_field.var_field.column,
+		      index_i, index_j, index_k, current_system, result_type);
+  return(matrix_elements[current_system][matrix_offset[current_system][variable] + row * no_tasks[current_system] + column]);
+}
+
+/* Returns the task of the current system that an index stands for */
+
+int field_task(int index_type, int task, int index_i, int index_j, int index_k, int current_system, int result_type)
+{
+  int index;
+
+  switch (index_type)
+    {
+    case SINGLE_INDEX :
+      return(task);
+
+    case I_INDEX :
+      index = index_i;
+      break;
+
+    case J_INDEX :
+      index = index_j;
+      break;
+
+    default :
+      index = index_k;
+      break;
+    }
+  if (result_type == GLOBAL_RESULT)
+    return(get_task_index(global_task_names[index], current_system));
+  return(index);
+}
+
 /* SIGMA_HP
 
    Performs a summation of elements of the indexed variables with
    a higher priority (Pj) than the current task (Pi)
 */
 
-double sigma_hp(formula_t position, int index_i, int current_system, int result_type)
+double sigma_hp(formula_t position, int index_i, int index_j, int current_system, int result_type)
 {
-  int counter, priority_var, max_index;
-  double sigma;
+  return(sigma_sum(position, index_i, index_j, current_system, result_type, SIGMA_HP_OP));
+}
 
-  sigma = 0.0;
-  priority_var = priority_variable[current_system];
+/* SIGMA_LP
+
+   Performs a summation of elements of the indexed variables with
+   a lower priority (Pj) than the current task (Pi)
+*/
+
+double sigma_lp(formula_t position, int index_i, int index_j, int current_system, int result_type)
+{
+  return(sigma_sum(position, index_i, index_j, current_system, result_type, SIGMA_LP_OP));
+}
+
+/* SIGMA_EP
+
+   Performs a summation of elements of the indexed variables with
+   the same priority (Pj) as the current task (Pi)
+   */
+
+double sigma_ep(formula_t position, int index_i, int index_j, int current_system, int result_type)
+{
+  return(sigma_sum(position, index_i, index_j, current_system, result_type, SIGMA_EP_OP));
+}
+
+/* SIGMA_ALL
+
+   Performs a summation of all elements of the indexed variables
+*/
+
+double sigma_all(formula_t position, int index_i, int index_j, int current_system, int result_type)
+{
+  return(sigma_sum(position, index_i, index_j, current_system, result_type, SIGMA_ALL_OP));
+}
+
+/* SIGMA_SUM
+
+   Performs a summation over the tasks j, or, if index_j is given,
+   a summation over the tasks k nested in the summation over j, whose
+   priorities are compared with that of task j. The sums of a nested
+   summation are kept in inner_sums as long as they can't change, so
+   that a double summation over n tasks usually costs n * n rather
+   than n * n * n evaluations for each task i.
+*/
+
+double sigma_sum(formula_t position, int index_i, int index_j, int current_system, int result_type, int operation)
+{
+  struct sigma_terms terms;
+  struct inner_sum *inner;
+  double sum;
+
+  inner = NULL;
+  if (index_j != INVALID) {
+    inner = find_inner_sum(position, current_system);
+    if ((inner != NULL) && fresh_inner_sum(inner, index_j, current_system))
+      return(inner->sums[index_j]);
+  }
 
+  terms.position = position;
+  terms.operation = operation;
+  terms.index_i = index_i;
+  terms.index_j = index_j;
+  terms.current_system = current_system;
+  terms.result_type = result_type;
   if (result_type == GLOBAL_RESULT)
-    max_index = no_global_tasks;
+    terms.max_index = no_global_tasks;
   else
-    max_index = no_tasks[current_system];
+    terms.max_index = no_tasks[current_system];
+  terms.no_chunks = (terms.max_index + SIGMA_CHUNK - 1) / SIGMA_CHUNK;
+  sum = add_terms(&terms);
+
+  if (inner != NULL) {
+    inner->sums[index_j] = sum;
+    inner->stamp[index_j] = clock_ticks[current_system];
+    inner->global_stamp[index_j] = global_clock;
+  }
+  return(sum);
+}
 
-  for (counter = 0; counter < max_index; counter++)
-    if ((counter != index_i) &&
-	(variables[current_system][priority_var][counter] < variables[current_system][priority_var][index_i]))
-      sigma += parse_rpn(position->next, index_i, counter, current_system, result_type);
-  return(sigma);
+/* ADD_TERMS
+
+   Adds up the elements of a summation in chunks of SIGMA_CHUNK tasks
+   and then the sums of the chunks in pairs. With -j, a summation of a
+   real system with at least SIGMA_PARALLEL chunks is shared by the
+   worker threads. Each thread has a stack of its own, the variables
+   are only read. As the chunks and the pairs don't depend on the
+   threads, neither does the result, and the exact comparisons of
+   calculate_task_set see the same values with any -j. With up to
+   SIGMA_CHUNK tasks the elements are simply added up in order.
+*/
+
+double add_terms(struct sigma_terms *terms)
+{
+  int chunk;
+
+  if (terms->no_chunks <= 1)
+    return((terms->no_chunks == 1) ? sigma_chunk(terms, 0) : 0.0);
+
+  if ((threads == 1) || (terms->no_chunks < SIGMA_PARALLEL) || (terms->current_system >= MAX_SYSTEMS) ||
+      (stack_slot != INVALID) || side_by_side || (sigma_job.terms != NULL)) {
+    for (chunk = 0; chunk < terms->no_chunks; chunk++)
+      terms->sums[chunk] = sigma_chunk(terms, chunk);
+    return(pairwise_sum(terms->sums, terms->no_chunks));
+  }
+
+  if (sigma_job.pid != getpid())
+    start_sigma_workers();
+  pthread_mutex_lock(&sigma_job.lock);
+  sigma_job.terms = terms;
+  sigma_job.finished = 0;
+  sigma_job.generation++;
+  pthread_cond_broadcast(&sigma_job.start);
+  pthread_mutex_unlock(&sigma_job.lock);
+
+  for (chunk = 0; chunk < terms->no_chunks; chunk += sigma_job.no_workers + 1)
+    terms->sums[chunk] = sigma_chunk(terms, chunk);
+
+  pthread_mutex_lock(&sigma_job.lock);
+  while (sigma_job.finished < sigma_job.no_workers)
+    pthread_cond_wait(&sigma_job.done, &sigma_job.lock);
+  sigma_job.terms = NULL;
+  pthread_mutex_unlock(&sigma_job.lock);
+  return(pairwise_sum(terms->sums, terms->no_chunks));
 }
 
-/* SIGMA_LP
+/* SIGMA_CHUNK
 
-   Performs a summation of elements of the indexed variables with
-   a lower priority (Pj) than the current task (Pi)
+   Adds up the elements of one chunk of a summation in task order.
 */
 
-double sigma_lp(formula_t position, int index_i, int current_system, int result_type)
+double sigma_chunk(struct sigma_terms *terms, int chunk)
 {
-  int counter, priority_var, max_index;
+  int counter, last;
   double sigma;
 
   sigma = 0.0;
-  priority_var = priority_variable[current_system];
+  last = (chunk + 1) * SIGMA_CHUNK;
+  if (last > terms->max_index)
+    last = terms->max_index;
+  for (counter = chunk * SIGMA_CHUNK; counter < last; counter++)
+    if (terms->index_j == INVALID) {
+      if (sigma_member(terms->operation, counter, terms->index_i, terms->current_system))
+	sigma += parse_rpn(terms->position->next, terms->index_i, counter, INVALID, terms->current_system, terms->result_type);
+    }
+    else if (sigma_member(terms->operation, counter, terms->index_j, terms->current_system))
+      sigma += parse_rpn(terms->position->next, terms->index_i, terms->index_j, counter, terms->current_system, terms->result_type);
+  return(sigma);
+}
 
-  if (result_type == GLOBAL_RESULT)
-    max_index = no_global_tasks;
+/* SIGMA_MEMBER
+
+   Tells whether task 'counter' takes part in a summation for task
+   index_i (or task j, for a nested summation).
+*/
+
+int sigma_member(int operation, int counter, int index_i, int current_system)
+{
+  double *priorities;
+
+  if (operation == SIGMA_ALL_OP)
+    return(TRUE);
+  priorities = variables[current_system][priority_variable[current_system]];
+  switch (operation)
+    {
+    case SIGMA_HP_OP :
+      return((counter != index_i) && (priorities[counter] < priorities[index_i]));
+
+    case SIGMA_LP_OP :
+      return(priorities[counter] > priorities[index_i]);
+
+    default :
+      return(priorities[counter] == priorities[index_i]);
+    }
+}
+
+/* END_OF_SIGMA
+
+   Returns the field that ends the summation starting at 'position'.
+*/
+
+formula_t end_of_sigma(formula_t position)
+{
+  int depth, operation;
+
+  depth = 0;
+  for (;; position = position->next)
+    if (position->field_type == OP_FIELD) {
+      operation = position->func_field.op_field.operation;
+      if ((operation == SIGMA_HP_OP) || (operation == SIGMA_LP_OP) ||
+	  (operation == SIGMA_EP_OP) || (operation == SIGMA_ALL_OP))
+	depth++;
+      else if ((operation == END_SIGMA_OP) && (--depth == 0))
+	return(position);
+    }
+}
+
+/* Returns the kept sums of a nested summation, or NULL */
+
+struct inner_sum *find_inner_sum(formula_t sigma, int current_system)
+{
+  int counter;
+
+  for (counter = 0; counter < no_inner_sums[current_system]; counter++)
+    if (inner_sums[current_system][counter].sigma == sigma)
+      return(&inner_sums[current_system][counter]);
+  return(NULL);
+}
+
+/* FRESH_INNER_SUM
+
+   Tells whether the kept sum of a nested summation for task j is
+   still valid: nothing it reads has changed since it was computed,
+   and the system wasn't touched. Local variables indexed by `j' only
+   count for element j.
+*/
+
+int fresh_inner_sum(struct inner_sum *inner, int index_j, int current_system)
+{
+  unsigned long version;
+  int read, variable, task;
+
+  if ((inner->stamp[index_j] < touched[current_system]) || (inner->global_stamp[index_j] < global_touched))
+    return(FALSE);
+  for (read = 0; read < inner->reads.no_reads; read++) {
+    variable = inner->reads.variable[read];
+    task = inner->reads.task[read];
+    if (inner->reads.global[read]) {
+      version = (task == INVALID) ? global_variable_versions[variable] : global_versions[variable][task];
+      if (version > inner->global_stamp[index_j])
+	return(FALSE);
+    }
+    else {
+      if (inner->reads.index_type[read] == J_INDEX)
+	task = index_j;
+      version = (task == INVALID) ? variable_versions[current_system][variable] : versions[current_system][variable][task];
+      if (version > inner->stamp[index_j])
+	return(FALSE);
+    }
+  }
+  return(TRUE);
+}
+
+/* PAIRWISE_SUM
+
+   Adds up the sums of the chunks of a summation: neighbours first,
+   then neighbouring pairs and so on. The sums are overwritten.
+*/
+
+double pairwise_sum(double *sums, int no_sums)
+{
+  int width, counter;
+
+  if (no_sums == 0)
+    return(0.0);
+  for (width = 1; width < no_sums; width *= 2)
+    for (counter = 0; counter + width < no_sums; counter += 2 * width)
+      sums[counter] += sums[counter + width];
+  return(sums[0]);
+}
+
+/* START_SIGMA_WORKERS
+
+   Starts the -j - 1 worker threads of sigma_sum. They are started
+   again in a process forked by --watch or --serve, which has none.
+*/
+
+void start_sigma_workers(void)
+{
+  pthread_t worker;
+  long counter;
+
+  pthread_mutex_init(&sigma_job.lock, NULL);
+  pthread_cond_init(&sigma_job.start, NULL);
+  pthread_cond_init(&sigma_job.done, NULL);
+  sigma_job.terms = NULL;
+  sigma_job.generation = 0;
+  sigma_job.no_workers = threads - 1;
+  sigma_job.pid = getpid();
+  for (counter = 1; counter <= sigma_job.no_workers; counter++)
+    if ((pthread_create(&worker, NULL, sigma_worker, (void *) counter) != 0) ||
+	(pthread_detach(worker) != 0)) {
+      fprintf(stderr, "Failed to start worker thread.\n");
+      exit(-1);
+    }
+}
+
+void *sigma_worker(void *argument)
+{
+  struct sigma_terms *terms;
+  int worker, generation, chunk;
+
+  worker = (long) argument;
+  stack_slot = MAX_SLOTS + worker - 1;
+  generation = 0;
+
+  pthread_mutex_lock(&sigma_job.lock);
+  for (;;) {
+    while (sigma_job.generation == generation)
+      pthread_cond_wait(&sigma_job.start, &sigma_job.lock);
+    generation = sigma_job.generation;
+    terms = sigma_job.terms;
+    pthread_mutex_unlock(&sigma_job.lock);
+
+    for (chunk = worker; chunk < terms->no_chunks; chunk += sigma_job.no_workers + 1)
+      terms->sums[chunk] = sigma_chunk(terms, chunk);
+
+    pthread_mutex_lock(&sigma_job.lock);
+    if (++sigma_job.finished == sigma_job.no_workers)
+      pthread_cond_signal(&sigma_job.done);
+  }
+  return(NULL);
+}
+
+/* EVALUATE_FORMULA
+
+   Evaluates one element of a formula, either through its native
+   kernel (if the formula was recognised by compile_kernels) or by
+   interpreting its RPN list
+*/
+
+double evaluate_formula(int current_system, int current_formula, int index_i, int result_type)
+{
+  if (kernels[current_system][current_formula] != NULL)
+    return(rta_kernel(kernels[current_system][current_formula], current_formula, index_i, current_system));
   else
-    max_index = no_tasks[current_system];
+    return(parse_rpn(formulas[current_system][current_formula], index_i, INVALID, INVALID, current_system, result_type));
+}
 
-  for (counter = 0;counter < max_index;counter++)
-    if (variables[current_system][priority_var][counter] > variables[current_system][priority_var][index_i])
-      sigma += parse_rpn(position->next, index_i, counter, current_system, result_type);
-  return(sigma);
+/* AFFINE_SOLUTION
+
+   Gives the fixed point of an element of an affine formula, x = a +
+   b * x, from the value it had, x0, and the next two values the
+   formula gave, f0 = a + b * x0 and f1 = a + b * f0. Then b = (f1 -
+   f0) / (f0 - x0), and iterating would end up at x = f1 + b * (f1 -
+   f0) / (1 - b). When |b| >= 1, iterating would never end, and
+   HUGE_VAL is returned.
+*/
+
+double affine_solution(double x0, double f0, double f1)
+{
+  double slope;
+
+  slope = (f1 - f0) / (f0 - x0);
+  if (fabs(slope) >= 1.0)
+    return(HUGE_VAL);
+  return(f1 + slope * (f1 - f0) / (1.0 - slope));
+}
+
+/* Tells that an element of an affine formula has no fixed point */
+
+void report_divergence(int current_system, int current_formula, int index_i)
+{
+  formula_t formula;
+  char *name;
+
+  formula = formulas[current_system][current_formula];
+  name = result_name(formula, current_system);
+  if (formula->func_field.definition.index_type == SCALAR)
+    fprintf(stderr, "System `%s':\nThe formula of `%s' diverges: it is %s = a + b * %s with |b| >= 1.\n",
+	    system_names[current_system], name, name, name);
+  else
+    fprintf(stderr, "System `%s':\nThe formula of `%s[%s]' diverges: it is %s = a + b * %s with |b| >= 1.\n",
+	    system_names[current_system], name, task_names[current_system][index_i], name, name);
+}
+
+/* RTA_KERNEL
+
+   Evaluates a formula of the standard response time analysis family
+   for task index_i, without going through the stack. The ceiling and
+   the division of the interference term are done in one go and the
+   summation only visits tasks of a higher priority, or, if they could
+   be grouped by group_tasks, only the groups.
+*/
+
+double rta_kernel(rta_kernel_t kernel, int current_formula, int index_i, int current_system)
+{
+  int term, counter, group, chunk, priority_var;
+  double result, value, response, period, sums[MAX_CHUNKS];
+  double *priorities, *periods, *costs, *jitters, *cost_sums;
+  struct task_groups *task_groups;
+
+  priority_var = priority_variable[current_system];
+  priorities = variables[current_system][priority_var];
+  periods = variables[current_system][kernel->period_variable];
+  costs = variables[current_system][kernel->cost_variable];
+  if (kernel->jitter_variable != INVALID)
+    jitters = variables[current_system][kernel->jitter_variable];
+  else
+    jitters = NULL;
+
+  result = 0.0;
+  for (term = 0; term < kernel->no_terms; term++) {
+    switch (kernel->term_type[term])
+      {
+      case CONST_FIELD :
+	value = kernel->term_constant[term];
+	break;
+
+      case VAR_FIELD :
+	if (kernel->term_index_type[term] == I_INDEX)
+	  value = variables[current_system][kernel->term_variable[term]][index_i];
+	else
+	  value = variables[current_system][kernel->term_variable[term]][0];
+	break;
+
+      default : /* The summation over higher priority tasks */
+	value = 0.0;
+	response = variables[current_system][kernel->response_variable][index_i];
+
+	/* With integral costs and a result that can't get near 2^52,
+	   every product and sum is exact, so adding up the groups gives
+	   the same result as adding up the tasks */
+
+	task_groups = group_tasks(kernel, current_formula, current_system);
+	if ((task_groups != NULL) &&
+	    (((fabs(response) + task_groups->largest_jitter) / task_groups->smallest_period + 1.0) *
+	     task_groups->total_cost < EXACT_LIMIT)) {
+	  cost_sums = task_groups->cost_sums[task_groups->level[index_i]];
+	  for (group = 0; group < task_groups->no_groups; group++)
+	    if (cost_sums[group] != 0.0)
+	      value += ceil((response + task_groups->group_jitter[group]) / task_groups->group_period[group]) * cost_sums[group];
+	  break;
+	}
+
+	/* Added up in the chunks of sigma_sum, to get its result */
+
+	for (chunk = 0; chunk * SIGMA_CHUNK < no_tasks[current_system]; chunk++) {
+	  sums[chunk] = 0.0;
+	  for (counter = chunk * SIGMA_CHUNK; (counter < (chunk + 1) * SIGMA_CHUNK) && (counter < no_tasks[current_system]); counter++)
+	    if ((counter != index_i) && (priorities[counter] < priorities[index_i])) {
+	      period = periods[counter];
+	      if (period == 0.0) {
+		fprintf(stderr, "Division by zero error in system `%s'.\n", system_names[current_system]);
+		exit(-1);
+	      }
+	      if (jitters != NULL)
+		sums[chunk] += ceil((response + jitters[counter]) / period) * costs[counter];
+	      else
+		sums[chunk] += ceil(response / period) * costs[counter];
+	    }
+	}
+	value = pairwise_sum(sums, chunk);
+	break;
+      }
+    if (term == 0)
+      result = value;
+    else
+      result = result + value;
+  }
+  return(result);
+}
+
+/* RTA_JUMP
+
+   Finds how far the recurrence of a kernel, R = f(R), can jump ahead
+   from 'response', which gave 'result' = f(response) > response. For
+   R >= response each ceiling((R+J[j])/T[j]) is at least the k[j] it
+   had and at least (R+J[j])/T[j], so f(R) >= g(R), the sum of the
+   larger of the two. g is piecewise linear and no fixed point of f
+   can be below the least one of g. That one is found by solving
+   R = a + u * R with the tasks whose linear part is the larger at the
+   current R, which only grows, until no other task joins them. A
+   margin for rounding is taken off, so that the iterations that
+   follow end at the same fixed point as they would without the jump.
+   Returns 'result' if it can't jump any further.
+*/
+
+double rta_jump(rta_kernel_t kernel, int index_i, int current_system, double response, double result)
+{
+  int counter, joined;
+  double outside, constant, slope, jump, *priorities, *periods, *costs, *jitters;
+  double ceilings[MAX_TASKS];
+  char linear[MAX_TASKS];
+
+  priorities = variables[current_system][priority_variable[current_system]];
+  periods = variables[current_system][kernel->period_variable];
+  costs = variables[current_system][kernel->cost_variable];
+  jitters = (kernel->jitter_variable != INVALID) ? variables[current_system][kernel->jitter_variable] : NULL;
+
+  outside = kernel_base(kernel, index_i, current_system);
+  for (counter = 0; counter < no_tasks[current_system]; counter++) {
+    linear[counter] = FALSE;
+    if ((counter != index_i) && (priorities[counter] < priorities[index_i])) {
+      if ((periods[counter] <= 0.0) || (costs[counter] < 0.0))
+	return(result);
+      ceilings[counter] = ceil((response + ((jitters != NULL) ? jitters[counter] : 0.0)) / periods[counter]);
+    }
+  }
+
+  jump = result;
+  do {
+    constant = outside;
+    slope = 0.0;
+    joined = FALSE;
+    for (counter = 0; counter < no_tasks[current_system]; counter++)
+      if ((counter != index_i) && (priorities[counter] < priorities[index_i])) {
+	if (!linear[counter] &&
+	    ((jump + ((jitters != NULL) ? jitters[counter] : 0.0)) / periods[counter] > ceilings[counter]))
+	  linear[counter] = joined = TRUE;
+	if (linear[counter]) {
+	  constant += ((jitters != NULL) ? jitters[counter] : 0.0) * costs[counter] / periods[counter];
+	  slope += costs[counter] / periods[counter];
+	}
+	else
+	  constant += ceilings[counter] * costs[counter];
+      }
+    if (slope >= 1.0)
+      return(result);
+    if (constant / (1.0 - slope) > jump)
+      jump = constant / (1.0 - slope);
+  } while (joined);
+
+  jump -= fabs(jump) * 4.0 * (no_tasks[current_system] + 2) * DBL_EPSILON / (1.0 - slope);
+  return((jump > result) ? jump : result);
+}
+
+/* COMPILE_KERNELS
+
+   Looks for formulas that can be evaluated by rta_kernel. Formulas
+   that don't match are left to the interpreter.
+*/
+
+void compile_kernels(int no_systems)
+{
+  int current_system, current_formula;
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+      kernels[current_system][current_formula] = match_kernel(formulas[current_system][current_formula], current_system);
+}
+
+/* COMPILE_AFFINE
+
+   Marks the formulas that affine_formula recognises, whose elements
+   are solved in one step by affine_solution instead of iterated.
+*/
+
+void compile_affine(int no_systems)
+{
+  int current_system, current_formula;
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+      affine[current_system][current_formula] = affine_formula(formulas[current_system][current_formula], current_system);
+}
+
+/* AFFINE_FORMULA
+
+   Checks that a formula reads the element it gives, x, and that it
+   is of the form x = a + b * x, where a and b don't depend on x.
+   The degree in x of each entry of the stack is worked out as the
+   formula would be evaluated: 0 for a value without x, 1 for one
+   affine in x. A summation is the sum of what its body gives, so it
+   has the degree of its body. Only local results that aren't
+   matrices are considered, and reads of other elements of the result
+   variable, or a result that is the priority variable while a
+   summation picks tasks by priority, make a formula not affine.
+*/
+
+int affine_formula(formula_t formula, int current_system)
+{
+  char degree[STACK_SIZE];
+  formula_t position;
+  int depth, index_type, result_var_index, self;
+  char *result_var_name;
+
+  result_var_name = result_name(formula, current_system);
+  index_type = formula->func_field.definition.index_type;
+  if (!check_variable(result_var_name, current_system) || (index_type == K_INDEX))
+    return(FALSE);
+  result_var_index = get_variable_index(result_var_name, current_system);
+  if (variable_types[current_system][result_var_index] == MATRIX_VAR)
+    return(FALSE);
+
+  self = FALSE;
+  depth = 0;
+  for (position = formula->next; position != NULL; position = position->next) {
+    if ((position->field_type == VAR_FIELD) || (position->field_type == CONST_FIELD)) {
+      if (depth == STACK_SIZE)
+	return(FALSE);
+      degree[depth] = 0;
+      if ((position->field_type == VAR_FIELD) &&
+	  (strcmp(field_name(position, current_system), result_var_name) == 0)) {
+	if ((position->func_field.op_field.var_field.column_type != INVALID) ||
+	    ((position->func_field.op_field.var_field.index_type != index_type) &&
+	     ((index_type != SINGLE_INDEX) || (position->func_field.op_field.var_field.index_type != I_INDEX))) ||
+	    ((position->func_field.op_field.var_field.index_type == SINGLE_INDEX) &&
+	     (strcmp(field_task_name(position, current_system),
+		     result_task(formula, current_system)) != 0)))
+	  return(FALSE);
+	degree[depth] = 1;
+	self = TRUE;
+      }
+      depth++;
+    }
+    else if (position->field_type == OP_FIELD)
+      switch (position->func_field.op_field.operation)
+	{
+	case PLUS_OP :
+	case MINUS_OP :
+	  degree[depth - 2] = (degree[depth - 2] > degree[depth - 1]) ? degree[depth - 2] : degree[depth - 1];
+	  depth--;
+	  break;
+	case MULTIPLY_OP :
+	  if (degree[depth - 2] + degree[depth - 1] > 1)
+	    return(FALSE);
+	  degree[depth - 2] += degree[depth - 1];
+	  depth--;
+	  break;
+	case DIVIDE_OP :
+	  if (degree[depth - 1] > 0)
+	    return(FALSE);
+	  depth--;
+	  break;
+	case MIN_OP :
+	case MAX_OP :
+	  if (degree[depth - 2] + degree[depth - 1] > 0)
+	    return(FALSE);
+	  depth--;
+	  break;
+	case FLOOR_OP :
+	case CEILING_OP :
+	  if (degree[depth - 1] > 0)
+	    return(FALSE);
+	  break;
+	case SIGMA_HP_OP :
+	case SIGMA_LP_OP :
+	case SIGMA_EP_OP :
+	  if (result_var_index == priority_variable[current_system])
+	    return(FALSE);
+	  break;
+	}
+  }
+  return(self && (depth == 1) && (degree[0] == 1));
+}
+
+/* RESOLVE_FORMULA
+
+   Gives the variables and tasks named in the fields of a formula as
+   their places in the tables of the system that declares it, or in
+   the global tables. A local variable hides a global one of the same
+   name. The names of the fields are not used after this, so a list
+   can be shared by systems that number their variables and tasks the
+   same way, whatever they call them.
+*/
+
+void resolve_formula(formula_t position, int current_system)
+{
+  char *name;
+
+  name = position->func_field.definition.result_variable;
+  position->func_field.definition.global = !check_variable(name, current_system);
+  position->func_field.definition.variable = position->func_field.definition.global ?
+    get_global_variable_index(name) : get_variable_index(name, current_system);
+  position->func_field.definition.task = INVALID;
+  if (position->func_field.definition.index_type == SINGLE_INDEX)
+    position->func_field.definition.task = position->func_field.definition.global ?
+      get_global_task_index(position->func_field.definition.result_index_task) :
+      get_task_index(position->func_field.definition.result_index_task, current_system);
+
+  for (position = position->next; position != NULL; position = position->next)
+    if (position->field_type == VAR_FIELD) {
+      name = position->func_field.op_field.var_field.variable_name;
+      position->func_field.op_field.var_field.global = !check_variable(name, current_system);
+      position->func_field.op_field.var_field.variable = position->func_field.op_field.var_field.global ?
+	get_global_variable_index(name) : get_variable_index(name, current_system);
+      position->func_field.op_field.var_field.task = INVALID;
+      if (position->func_field.op_field.var_field.index_type == SINGLE_INDEX)
+	position->func_field.op_field.var_field.task = position->func_field.op_field.var_field.global ?
+	  get_global_task_index(position->func_field.op_field.var_field.variable_index_task) :
+	  get_task_index(position->func_field.op_field.var_field.variable_index_task, current_system);
+      position->func_field.op_field.var_field.column = INVALID;
+      if (position->func_field.op_field.var_field.column_type == SINGLE_INDEX)
+	position->func_field.op_field.var_field.column =
+	  get_task_index(position->func_field.op_field.var_field.column_task, current_system);
+    }
+}
+
+/* RESULT_NAME, RESULT_TASK, FIELD_NAME, FIELD_TASK_NAME, COLUMN_TASK_NAME
+
+   The names of the result of a formula, of the variable read by a
+   field and of the tasks of their indices, in the system that
+   evaluates the formula (see resolve_formula).
+*/
+
+char *result_name(formula_t formula, int current_system)
+{
+  if (formula->func_field.definition.global)
+    return(global_variable_names[formula->func_field.definition.variable]);
+  return(variable_names[current_system][formula->func_field.definition.variable]);
+}
+
+char *result_task(formula_t formula, int current_system)
+{
+  if (formula->func_field.definition.global)
+    return(global_task_names[formula->func_field.definition.task]);
+  return(task_names[current_system][formula->func_field.definition.task]);
+}
+
+char *field_name(formula_t position, int current_system)
+{
+  if (position->func_field.op_field.var_field.global)
+    return(global_variable_names[position->func_field.op_field.var_field.variable]);
+  return(variable_names[current_system][position->func_field.op_field.var_field.variable]);
+}
+
+char *field_task_name(formula_t position, int current_system)
+{
+  if (position->func_field.op_field.var_field.global)
+    return(global_task_names[position->func_field.op_field.var_field.task]);
+  return(task_names[current_system][position->func_field.op_field.var_field.task]);
+}
+
+char *column_task_name(formula_t position, int current_system)
+{
+  return(task_names[current_system][position->func_field.op_field.var_field.column]);
+}
+
+/* SHARE_FORMULAS
+
+   Lets formulas with the same structure share one list of fields,
+   across systems and within a system. The fields are compared by the
+   places of their variables and tasks (see resolve_formula), not by
+   their names, so systems that use the same formulas on their own
+   variables and tasks share them, and only their kernels and
+   bindings differ. The duplicates are freed.
+*/
+
+void share_formulas(int no_systems)
+{
+  formula_t table[FORMULA_TABLE];
+  int current_system, current_formula, slot;
+  formula_t position, next;
+
+  for (slot = 0; slot < FORMULA_TABLE; slot++)
+    table[slot] = NULL;
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      position = formulas[current_system][current_formula];
+      if (position == NULL)
+	continue;
+      slot = hash_formula(position) % FORMULA_TABLE;
+      while ((table[slot] != NULL) && !same_formula(table[slot], position))
+	slot = (slot + 1) % FORMULA_TABLE;
+      if (table[slot] == NULL)
+	table[slot] = position;
+      else if (table[slot] != position) {   /* Not already shared by a variant */
+	for (; position != NULL; position = next) {
+	  next = position->next;
+	  free(position);
+	}
+	formulas[current_system][current_formula] = table[slot];
+      }
+    }
+}
+
+/* HASH_FORMULA
+
+   Hashes the fields of a formula (FNV-1a) for share_formulas.
+*/
+
+unsigned long hash_formula(formula_t position)
+{
+  unsigned long hash = 2166136261UL;
+  unsigned char bytes[sizeof(struct formula)];
+  size_t size, counter;
+
+  for (; position != NULL; position = position->next) {
+    size = field_bytes(position, bytes);
+    for (counter = 0; counter < size; counter++)
+      hash = (hash ^ bytes[counter]) * 16777619UL;
+  }
+  return(hash);
+}
+
+/* FIELD_BYTES
+
+   Writes what makes up a formula field to bytes, the same for fields
+   that same_formula finds equal: the type, the index type or the
+   operation, the place of a variable and of the tasks of its indices
+   (see resolve_formula) and the bits of a constant. Returns the
+   number of bytes.
+*/
+
+size_t field_bytes(formula_t position, unsigned char *bytes)
+{
+  int values[7];
+  size_t size;
+
+  values[0] = position->field_type;
+  values[1] = values[2] = values[3] = values[4] = values[5] = values[6] = INVALID;
+  switch (position->field_type)
+    {
+    case DEF_FIELD :
+      values[1] = position->func_field.definition.index_type;
+      values[2] = position->func_field.definition.column_type;
+      values[3] = position->func_field.definition.variable;
+      values[4] = position->func_field.definition.global;
+      values[5] = position->func_field.definition.task;
+      break;
+
+    case VAR_FIELD :
+      values[1] = position->func_field.op_field.var_field.index_type;
+      values[2] = position->func_field.op_field.var_field.column_type;
+      values[3] = position->func_field.op_field.var_field.variable;
+      values[4] = position->func_field.op_field.var_field.global;
+      values[5] = position->func_field.op_field.var_field.task;
+      values[6] = position->func_field.op_field.var_field.column;
+      break;
+
+    case OP_FIELD :
+      values[1] = position->func_field.op_field.operation;
+      break;
+    }
+  memcpy(bytes, values, sizeof(values));
+  size = sizeof(values);
+  if (position->field_type == CONST_FIELD) {
+    memcpy(bytes + size, &position->func_field.op_field.constant, sizeof(double));
+    size += sizeof(double);
+  }
+  return(size);
+}
+
+/* SAME_FORMULA
+
+   Returns TRUE if two formulas consist of the same fields.
+*/
+
+int same_formula(formula_t first, formula_t second)
+{
+  unsigned char first_bytes[sizeof(struct formula)], second_bytes[sizeof(struct formula)];
+  size_t size;
+
+  for (; (first != NULL) && (second != NULL); first = first->next, second = second->next) {
+    size = field_bytes(first, first_bytes);
+    if ((field_bytes(second, second_bytes) != size) || memcmp(first_bytes, second_bytes, size))
+      return(FALSE);
+  }
+  return(first == second);
+}
+
+/* FREE_FORMULA
+
+   Frees the fields of a formula of a system. A list shared with
+   formulas that are freed later is only freed once.
+*/
+
+void free_formula(int current_system, int current_formula)
+{
+  formula_t position, next;
+  int counter, counter2;
+
+  position = formulas[current_system][current_formula];
+  if (position == NULL)
+    return;
+  for (counter = current_system; counter < MAX_SYSTEMS; counter++)
+    for (counter2 = 0; counter2 < MAX_FORMULAS; counter2++)
+      if (formulas[counter][counter2] == position)
+	formulas[counter][counter2] = NULL;
+  for (; position != NULL; position = next) {
+    next = position->next;
+    free(position);
+  }
+}
+
+/* GROUP_TASKS
+
+   Groups the tasks of a system for the summation of a kernel formula.
+   The groups are kept until the priorities, periods, costs or jitters
+   change. Returns NULL if the summation should visit the tasks: when
+   a cost isn't integral, a period is zero, or there are too many
+   groups for grouping to pay off.
+*/
+
+struct task_groups *group_tasks(rta_kernel_t kernel, int current_formula, int current_system)
+{
+  struct task_groups *task_groups;
+  int order[MAX_TASKS];
+  int counter, position, group, task;
+  double *priorities, *periods, *costs, jitter;
+
+  task_groups = &groups[current_system];
+  if ((task_groups->formula == current_formula) &&
+      (task_groups->stamp >= touched[current_system]) &&
+      (variable_versions[current_system][priority_variable[current_system]] <= task_groups->stamp) &&
+      (variable_versions[current_system][kernel->period_variable] <= task_groups->stamp) &&
+      (variable_versions[current_system][kernel->cost_variable] <= task_groups->stamp) &&
+      ((kernel->jitter_variable == INVALID) ||
+       (variable_versions[current_system][kernel->jitter_variable] <= task_groups->stamp)))
+    return(task_groups->usable ? task_groups : NULL);
+
+  task_groups->formula = current_formula;
+  task_groups->stamp = clock_ticks[current_system];
+  task_groups->usable = FALSE;
+  task_groups->no_groups = 0;
+  task_groups->largest_jitter = 0.0;
+  task_groups->smallest_period = MAXDOUBLE;
+  task_groups->total_cost = 0.0;
+  priorities = variables[current_system][priority_variable[current_system]];
+  periods = variables[current_system][kernel->period_variable];
+  costs = variables[current_system][kernel->cost_variable];
+
+  priority_order(current_system, order);
+  for (group = 0; group < MAX_GROUPS; group++)
+    task_groups->cost_sums[0][group] = 0.0;
+
+  for (position = 0; position < no_tasks[current_system]; position++) {
+    task = order[position];
+    jitter = (kernel->jitter_variable != INVALID) ? variables[current_system][kernel->jitter_variable][task] : 0.0;
+    if ((periods[task] == 0.0) || (costs[task] != floor(costs[task])) || !isfinite(costs[task]) || !isfinite(jitter))
+      return(NULL);
+
+    for (group = 0; group < task_groups->no_groups; group++)
+      if ((task_groups->group_period[group] == periods[task]) && (task_groups->group_jitter[group] == jitter))
+	break;
+    if (group == task_groups->no_groups) {
+      if ((group == MAX_GROUPS) || (2 * (group + 1) > no_tasks[current_system]))
+	return(NULL);
+      task_groups->group_period[group] = periods[task];
+      task_groups->group_jitter[group] = jitter;
+      task_groups->no_groups++;
+    }
+
+    for (counter = 0; counter < MAX_GROUPS; counter++)
+      task_groups->cost_sums[position + 1][counter] = task_groups->cost_sums[position][counter];
+    task_groups->cost_sums[position + 1][group] += costs[task];
+
+    if ((position > 0) && (priorities[task] == priorities[order[position - 1]]))
+      task_groups->level[task] = task_groups->level[order[position - 1]];
+    else
+      task_groups->level[task] = position;
+
+    task_groups->largest_jitter = max(task_groups->largest_jitter, fabs(jitter));
+    task_groups->smallest_period = min(task_groups->smallest_period, fabs(periods[task]));
+    task_groups->total_cost += fabs(costs[task]);
+  }
+
+  task_groups->usable = TRUE;
+  return(task_groups);
+}
+
+/* COLLECT_READS
+
+   Finds the variables read by each formula, for needs_evaluation.
+   The summations over higher, lower and equal priority tasks also
+   read the priority variable.
+*/
+
+void collect_reads(int no_systems)
+{
+  struct formula_reads *formula_reads;
+  formula_t position;
+  int current_system, current_formula, global_result;
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      formula_reads = &reads[current_system][current_formula];
+      formula_reads->untracked = FALSE;
+      formula_reads->no_reads = 0;
+      global_result = !check_variable(result_name(formulas[current_system][current_formula], current_system), current_system);
+
+      for (position = formulas[current_system][current_formula]; position != NULL; position = position->next)
+	if (position->field_type == OP_FIELD) {
+	  if (((position->func_field.op_field.operation == SIGMA_HP_OP) ||
+	       (position->func_field.op_field.operation == SIGMA_LP_OP) ||
+	       (position->func_field.op_field.operation == SIGMA_EP_OP)) &&
+	      (priority_variable[current_system] != INVALID))
+	    add_read(formula_reads, priority_variable[current_system], J_INDEX, INVALID, FALSE);
+	}
+	else if (position->field_type == VAR_FIELD)
+	  add_field_read(formula_reads, position, current_system, global_result);
+    }
+}
+
+/* COLLECT_INNER_SUMS
+
+   Finds the nested summations whose sums can be kept in inner_sums:
+   those of formulas with a local result that read nothing indexed
+   by `i'. They also read all priorities.
+*/
+
+void collect_inner_sums(int no_systems)
+{
+  struct inner_sum *inner;
+  formula_t position, sigma, end;
+  int current_system, current_formula, operation, depth, kept;
+
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    no_inner_sums[current_system] = 0;
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      if (!check_variable(result_name(formulas[current_system][current_formula], current_system), current_system))
+	continue;
+
+      /* The body of a matrix formula is like that of a summation */
+
+      depth = (formulas[current_system][current_formula]->func_field.definition.column_type != INVALID) ? 1 : 0;
+      for (sigma = formulas[current_system][current_formula]; sigma != NULL; sigma = sigma->next) {
+	if (sigma->field_type != OP_FIELD)
+	  continue;
+	operation = sigma->func_field.op_field.operation;
+	if (operation == END_SIGMA_OP) {
+	  depth--;
+	  continue;
+	}
+	if ((operation != SIGMA_HP_OP) && (operation != SIGMA_LP_OP) &&
+	    (operation != SIGMA_EP_OP) && (operation != SIGMA_ALL_OP))
+	  continue;
+	if ((++depth != 2) || (no_inner_sums[current_system] == MAX_INNER_SUMS) ||
+	    (find_inner_sum(sigma, current_system) != NULL))
+	  continue;
+
+	inner = &inner_sums[current_system][no_inner_sums[current_system]];
+	inner->sigma = sigma;
+	inner->reads.untracked = FALSE;
+	inner->reads.no_reads = 0;
+	if ((operation != SIGMA_ALL_OP) && (priority_variable[current_system] != INVALID))
+	  add_read(&inner->reads, priority_variable[current_system], K_INDEX, INVALID, FALSE);
+	kept = TRUE;
+	end = end_of_sigma(sigma);
+	for (position = sigma->next; position != end; position = position->next)
+	  if (position->field_type == VAR_FIELD) {
+	    if ((position->func_field.op_field.var_field.index_type == I_INDEX) ||
+		(position->func_field.op_field.var_field.column_type == I_INDEX))
+	      kept = FALSE;
+	    add_field_read(&inner->reads, position, current_system, FALSE);
+	  }
+	if (kept && !inner->reads.untracked)
+	  no_inner_sums[current_system]++;
+      }
+    }
+  }
+}
+
+/* Adds the variable of a field to the reads of a formula */
+
+void add_field_read(struct formula_reads *formula_reads, formula_t position, int current_system, int global_result)
+{
+  char *name, *task_name;
+  int index_type, global, variable, task;
+
+  name = field_name(position, current_system);
+  task_name = field_task_name(position, current_system);
+  index_type = position->func_field.op_field.var_field.index_type;
+  task = INVALID;
+  if (check_variable(name, current_system)) {
+    variable = get_variable_index(name, current_system);
+    global = FALSE;
+  }
+  else if (check_global_variable(name)) {
+    variable = get_global_variable_index(name);
+    global = TRUE;
+  }
+  else {
+    formula_reads->untracked = TRUE;
+    return;
+  }
+
+  /* The tasks of a formula with a global result are the global
+     tasks, and a global variable read with `i' is indexed by the global
+     task of that name, so `i' says nothing about the elements read then */
+
+  if ((index_type == I_INDEX) && (global_result || global))
+    index_type = J_INDEX;
+  else if (index_type == SINGLE_INDEX) {
+    if (global && check_global_task(task_name))
+      task = get_global_task_index(task_name);
+    else if (!global && check_task(task_name, current_system))
+      task = get_task_index(task_name, current_system);
+    else
+      formula_reads->untracked = TRUE;
+  }
+  add_read(formula_reads, variable, index_type, task, global);
+}
+
+void add_read(struct formula_reads *formula_reads, int variable, int index_type, int task, int global)
+{
+  int read;
+
+  for (read = 0; read < formula_reads->no_reads; read++)
+    if ((formula_reads->variable[read] == variable) && (formula_reads->index_type[read] == index_type) &&
+	(formula_reads->task[read] == task) && (formula_reads->global[read] == global))
+      return;
+  if (formula_reads->no_reads == MAX_READS) {
+    formula_reads->untracked = TRUE;
+    return;
+  }
+  formula_reads->variable[formula_reads->no_reads] = variable;
+  formula_reads->index_type[formula_reads->no_reads] = index_type;
+  formula_reads->task[formula_reads->no_reads] = task;
+  formula_reads->global[formula_reads->no_reads] = global;
+  formula_reads->no_reads++;
+}
+
+/* NEEDS_EVALUATION
+
+   Every change of a variable is stamped with the next tick of the
+   clock of its system (or the global clock), both on the element and
+   on the variable as a whole. An evaluation of a formula for a task
+   remembers the clocks when it was done. It only has to be repeated
+   if something it reads has changed since then, or if the system was
+   touched by anything but the formulas.
+*/
+
+int needs_evaluation(int current_system, int current_formula, int index_i)
+{
+  struct formula_reads *formula_reads;
+  unsigned long stamp, global_stamp, version;
+  int read, variable, task;
+
+  formula_reads = &reads[current_system][current_formula];
+  stamp = evaluated[current_system][current_formula][index_i];
+  global_stamp = global_evaluated[current_system][current_formula][index_i];
+  if (formula_reads->untracked || (stamp < touched[current_system]) || (global_stamp < global_touched))
+    return(TRUE);
+
+  for (read = 0; read < formula_reads->no_reads; read++) {
+    variable = formula_reads->variable[read];
+    if (formula_reads->index_type[read] == I_INDEX)
+      task = index_i;
+    else
+      task = formula_reads->task[read];
+    if (formula_reads->global[read]) {
+      version = (task == INVALID) ? global_variable_versions[variable] : global_versions[variable][task];
+      if (version > global_stamp)
+	return(TRUE);
+    }
+    else {
+      version = (task == INVALID) ? variable_versions[current_system][variable] : versions[current_system][variable][task];
+      if (version > stamp)
+	return(TRUE);
+    }
+  }
+  return(FALSE);
+}
+
+/* Writes an element of a variable, stamping it if it changes */
+
+void set_element(int current_system, int variable, int task, double value)
+{
+  if (variables[current_system][variable][task] != value) {
+    variables[current_system][variable][task] = value;
+    versions[current_system][variable][task] = variable_versions[current_system][variable] = ++clock_ticks[current_system];
+  }
+}
+
+/* An element of a matrix is stamped on its row */
+
+void set_matrix_element(int current_system, int variable, int row, int column, double value)
+{
+  double *element;
+
+  element = &matrix_elements[current_system][matrix_offset[current_system][variable] + row * no_tasks[current_system] + column];
+  if (*element != value) {
+    *element = value;
+    versions[current_system][variable][row] = variable_versions[current_system][variable] = ++clock_ticks[current_system];
+  }
+}
+
+void set_global_element(int variable, int task, double value)
+{
+  if (global_variables[variable][task] != value) {
+    global_variables[variable][task] = value;
+    global_versions[variable][task] = global_variable_versions[variable] = ++global_clock;
+  }
+}
+
+/* TOUCH_SYSTEM
+
+   Has to be called after the variables of a system were changed
+   other than by set_element, so that all its formulas are evaluated
+   again. touch_globals does the same for the global variables.
+*/
+
+void touch_system(int current_system)
+{
+  touched[current_system] = ++clock_ticks[current_system];
+}
+
+void touch_globals(void)
+{
+  global_touched = ++global_clock;
+}
+
+/* MATCH_KERNEL
+
+   Matches a formula against the pattern
+
+     X[i] = term + term + ... ;
+
+   where exactly one of the terms is a summation over higher priority
+   tasks accepted by match_kernel_sigma, and the other terms are
+   constants, local scalars or local variables indexed by `i'. The
+   result must be a local indexed variable. Returns NULL if the formula
+   doesn't match.
+*/
+
+rta_kernel_t match_kernel(formula_t position, int current_system)
+{
+  struct rta_kernel kernel;
+  rta_kernel_t result;
+  int no_sigmas, variable_index, result_var_index, term;
+
+  if ((position->func_field.definition.index_type != I_INDEX) ||
+      (position->func_field.definition.column_type != INVALID) ||
+      !check_variable(result_name(position, current_system), current_system))
+    return(NULL);
+  result_var_index = get_variable_index(result_name(position, current_system), current_system);
+
+  kernel.no_terms = 0;
+  no_sigmas = 0;
+  position = position->next;
+
+  /* The terms are added from left to right, so the RPN list looks
+     like: term term PLUS term PLUS ... */
+
+  while (position != NULL) {
+    if (kernel.no_terms == MAX_KERNEL_TERMS)
+      return(NULL);
+
+    switch (position->field_type)
+      {
+      case CONST_FIELD :
+	kernel.term_type[kernel.no_terms] = CONST_FIELD;
+	kernel.term_constant[kernel.no_terms] = position->func_field.op_field.constant;
+	break;
+
+      case VAR_FIELD :
+	if ((variable_index = match_local_variable(position, I_INDEX, current_system)) != INVALID)
+	  kernel.term_index_type[kernel.no_terms] = I_INDEX;
+	else if ((variable_index = match_local_variable(position, SCALAR, current_system)) != INVALID)
+	  kernel.term_index_type[kernel.no_terms] = SCALAR;
+	else
+	  return(NULL);
+	kernel.term_type[kernel.no_terms] = VAR_FIELD;
+	kernel.term_variable[kernel.no_terms] = variable_index;
+	break;
+
+      case OP_FIELD :
+	if ((no_sigmas > 0) || (position->func_field.op_field.operation != SIGMA_HP_OP))
+	  return(NULL);
+	position = match_kernel_sigma(position, &kernel, current_system);
+	if (position == NULL)
+	  return(NULL);
+	kernel.term_type[kernel.no_terms] = OP_FIELD;
+	no_sigmas++;
+	break;
+
+      default :
+	return(NULL);
+      }
+
+    position = position->next;
+    if (++kernel.no_terms > 1) {
+      if ((position == NULL) || (position->field_type != OP_FIELD) ||
+	  (position->func_field.op_field.operation != PLUS_OP))
+	return(NULL);
+      position = position->next;
+    }
+  }
+
+  if (no_sigmas != 1)
+    return(NULL);
+
+  /* The recurrence R = f(R) can jump ahead when nothing but the
+     ceiling depends on R */
+
+  kernel.jump = (kernel.response_variable == result_var_index) &&
+    (kernel.period_variable != result_var_index) && (kernel.cost_variable != result_var_index) &&
+    (kernel.jitter_variable != result_var_index) && (priority_variable[current_system] != result_var_index);
+  for (term = 0; term < kernel.no_terms; term++)
+    if ((kernel.term_type[term] == VAR_FIELD) && (kernel.term_variable[term] == result_var_index))
+      kernel.jump = FALSE;
+
+  result = malloc(sizeof(struct rta_kernel));
+  if (result == NULL) {
+    fprintf(stderr, "Failed to allocate memory for formula.\n");
+    exit(-1);
+  }
+  *result = kernel;
+  return(result);
+}
+
+/* MATCH_KERNEL_SIGMA
+
+   Matches the body of a sigma(hp, ...) summation against
+
+     ceiling(R[i]/T[j])*C[j]    or    ceiling((R[i]+J[j])/T[j])*C[j]
+
+   with the factors and the terms of the addition in either order. On
+   success, the variables are filled in in 'kernel' and the END_SIGMA
+   field is returned. Otherwise NULL is returned.
+*/
+
+formula_t match_kernel_sigma(formula_t position, rta_kernel_t kernel, int current_system)
+{
+  formula_t body[8], cost;
+  int no_fields, first;
+
+  no_fields = 0;
+  for (position = position->next; position != NULL; position = position->next) {
+    if ((position->field_type == OP_FIELD) &&
+	(position->func_field.op_field.operation == END_SIGMA_OP))
+      break;
+    if (no_fields == 8)
+      return(NULL);
+    body[no_fields++] = position;
+  }
+  if ((position == NULL) || ((no_fields != 6) && (no_fields != 8)) ||
+      (body[no_fields - 1]->field_type != OP_FIELD) ||
+      (body[no_fields - 1]->func_field.op_field.operation != MULTIPLY_OP))
+    return(NULL);
+
+  /* C[j] is either the first or the second last field */
+
+  if ((body[no_fields - 2]->field_type == OP_FIELD) &&
+      (body[no_fields - 2]->func_field.op_field.operation == CEILING_OP)) {
+    cost = body[0];
+    first = 1;
+  }
+  else {
+    cost = body[no_fields - 2];
+    first = 0;
+  }
+  if ((kernel->cost_variable = match_local_variable(cost, J_INDEX, current_system)) == INVALID)
+    return(NULL);
+
+  /* What is left is the ceiling: R[i] T[j] DIVIDE CEILING, possibly with
+     R[i] replaced by R[i] J[j] PLUS or J[j] R[i] PLUS */
+
+  if ((body[first + no_fields - 3]->field_type != OP_FIELD) ||
+      (body[first + no_fields - 3]->func_field.op_field.operation != CEILING_OP) ||
+      (body[first + no_fields - 4]->field_type != OP_FIELD) ||
+      (body[first + no_fields - 4]->func_field.op_field.operation != DIVIDE_OP))
+    return(NULL);
+  if ((kernel->period_variable = match_local_variable(body[first + no_fields - 5], J_INDEX, current_system)) == INVALID)
+    return(NULL);
+
+  if (no_fields == 6) {
+    kernel->jitter_variable = INVALID;
+    kernel->response_variable = match_local_variable(body[first], I_INDEX, current_system);
+  }
+  else {
+    if ((body[first + 2]->field_type != OP_FIELD) ||
+	(body[first + 2]->func_field.op_field.operation != PLUS_OP))
+      return(NULL);
+    kernel->response_variable = match_local_variable(body[first], I_INDEX, current_system);
+    kernel->jitter_variable = match_local_variable(body[first + 1], J_INDEX, current_system);
+    if (kernel->response_variable == INVALID) {
+      kernel->response_variable = match_local_variable(body[first + 1], I_INDEX, current_system);
+      kernel->jitter_variable = match_local_variable(body[first], J_INDEX, current_system);
+    }
+    if (kernel->jitter_variable == INVALID)
+      return(NULL);
+  }
+  if (kernel->response_variable == INVALID)
+    return(NULL);
+
+  return(position);
+}
+
+/* MATCH_LOCAL_VARIABLE
+
+   Returns the index of the variable in 'position' if it is a variable
+   of the current system used with the given index type, otherwise
+   INVALID
+*/
+
+int match_local_variable(formula_t position, int index_type, int current_system)
+{
+  if ((position->field_type != VAR_FIELD) ||
+      (position->func_field.op_field.var_field.index_type != index_type) ||
+      (position->func_field.op_field.var_field.column_type != INVALID) ||
+      !check_variable(field_name(position, current_system), current_system))
+    return(INVALID);
+  else
+    return(get_variable_index(field_name(position, current_system), current_system));
+}
+
+/* KERNEL_BASE
+
+   Returns the sum of the terms of a kernel formula outside the
+   summation, e.g. C[i] + B[i]
+*/
+
+double kernel_base(rta_kernel_t kernel, int index_i, int current_system)
+{
+  int term;
+  double base;
+
+  base = 0.0;
+  for (term = 0; term < kernel->no_terms; term++)
+    if (kernel->term_type[term] == CONST_FIELD)
+      base += kernel->term_constant[term];
+    else if (kernel->term_type[term] == VAR_FIELD) {
+      if (kernel->term_index_type[term] == I_INDEX)
+	base += variables[current_system][kernel->term_variable[term]][index_i];
+      else
+	base += variables[current_system][kernel->term_variable[term]][0];
+    }
+  return(base);
+}
+
+/* KERNEL_READS
+
+   Checks if a kernel formula depends on a variable of its system
+*/
+
+int kernel_reads(rta_kernel_t kernel, int current_system, int variable_index)
+{
+  int term;
+
+  if ((variable_index == kernel->response_variable) ||
+      (variable_index == kernel->jitter_variable) ||
+      (variable_index == kernel->period_variable) ||
+      (variable_index == kernel->cost_variable) ||
+      (variable_index == priority_variable[current_system]))
+    return(TRUE);
+  for (term = 0; term < kernel->no_terms; term++)
+    if ((kernel->term_type[term] == VAR_FIELD) &&
+	(kernel->term_variable[term] == variable_index))
+      return(TRUE);
+  return(FALSE);
+}
+
+/* PREFILTER
+
+   Decides as many tasks as possible of a system with sufficient
+   schedulability tests, before any iteration is done. It needs a
+   response time formula that is evaluated by rta_kernel, and whose
+   inputs aren't the results of other formulas. A task is compared
+   against its deadline, or its period if no deadline variable has
+   been declared.
+
+   Three tests are used:
+
+   - The Liu & Layland bound and the hyperbolic bound, for the whole
+     system, when the priorities are rate monotonic, there is no
+     blocking or jitter and the deadlines are not shorter than the
+     periods.
+   - Bini's response time upper bound, which proves a task
+     schedulable: (B + C + sum(hp, C(1 - U) + JU)) / (1 - sum(hp, U))
+   - The lower bound C + B + sum(hp, C), or a higher priority
+     utilisation of 1 or more, which proves a task unschedulable.
+
+   The higher priority sums are built up in priority order, so all
+   the tests together take O(n log n). Returns TRUE if every task of
+   the system was decided.
+*/
+
+int prefilter(int current_system)
+{
+  rta_kernel_t kernel;
+  int order[MAX_TASKS];
+  int current_formula, result_var_index, counter, task, first, last, all_decided;
+  double *priorities, *periods, *costs, *jitters, *responses;
+  double hp_utilisation, hp_costs, hp_workload, task_utilisation;
+  double base, deadline, bound, level_utilisation, level_costs, level_workload;
+
+  verdict_formula[current_system] = find_response_formula(current_system);
+  utilisation_test[current_system] = FALSE;
+  for (task = 0; task < no_tasks[current_system]; task++)
+    verdicts[current_system][task] = UNDECIDED;
+  if ((verdict_formula[current_system] == INVALID) ||
+      (kernels[current_system][verdict_formula[current_system]] == NULL))
+    return(FALSE);
+  kernel = kernels[current_system][verdict_formula[current_system]];
+
+  /* The system can only be skipped if no other system reads its results,
+     and the bounds only hold if the inputs of the response time formula
+     are constant. */
+
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+    if (!check_variable(result_name(formulas[current_system][current_formula], current_system), current_system))
+      return(FALSE);
+    result_var_index = get_variable_index(result_name(formulas[current_system][current_formula], current_system), current_system);
+    if ((current_formula != verdict_formula[current_system]) &&
+	kernel_reads(kernel, current_system, result_var_index))
+      return(FALSE);
+  }
+
+  priorities = variables[current_system][priority_variable[current_system]];
+  periods = variables[current_system][kernel->period_variable];
+  costs = variables[current_system][kernel->cost_variable];
+  responses = variables[current_system][kernel->response_variable];
+  if (kernel->jitter_variable != INVALID)
+    jitters = variables[current_system][kernel->jitter_variable];
+  else
+    jitters = NULL;
+
+  /* The iteration must start from below the fixed point for the bounds
+     to say anything about the result of the exact analysis. */
+
+  for (task = 0; task < no_tasks[current_system]; task++)
+    if ((costs[task] < 0.0) || (periods[task] <= 0.0) ||
+	((jitters != NULL) && (jitters[task] < 0.0)) ||
+	(responses[task] > kernel_base(kernel, task, current_system)))
+      return(FALSE);
+
+  priority_order(current_system, order);
+
+  /* Liu & Layland and the hyperbolic bound */
+
+  utilisation_test[current_system] = (kernel->no_terms == 2);
+  for (counter = 0; counter < kernel->no_terms; counter++)
+    if ((kernel->term_type[counter] != OP_FIELD) &&
+	((kernel->term_type[counter] != VAR_FIELD) ||
+	 (kernel->term_index_type[counter] != I_INDEX) ||
+	 (kernel->term_variable[counter] != kernel->cost_variable)))
+      utilisation_test[current_system] = FALSE;
+  utilisation[current_system] = 0.0;
+  hyperbolic_product[current_system] = 1.0;
+  for (counter = 0; counter < no_tasks[current_system]; counter++) {
+    task = order[counter];
+    if ((jitters != NULL) && (jitters[task] != 0.0))
+      utilisation_test[current_system] = FALSE;
+    if ((deadline_variable[current_system] != INVALID) &&
+	(variables[current_system][deadline_variable[current_system]][task] < periods[task]))
+      utilisation_test[current_system] = FALSE;
+    if ((counter > 0) &&
+	((priorities[order[counter - 1]] == priorities[task]) ||
+	 (periods[order[counter - 1]] > periods[task])))
+      utilisation_test[current_system] = FALSE;
+    utilisation[current_system] += costs[task] / periods[task];
+    hyperbolic_product[current_system] *= costs[task] / periods[task] + 1.0;
+  }
+  if (utilisation_test[current_system] && (hyperbolic_product[current_system] <= 2.0)) {
+    for (task = 0; task < no_tasks[current_system]; task++) {
+      verdicts[current_system][task] = SCHEDULABLE;
+      verdict_tests[current_system][task] = UTILISATION_TEST;
+    }
+    return(TRUE);
+  }
+
+  /* Response time bounds, one priority level at a time. Tasks of the
+     same priority don't interfere with each other. */
+
+  hp_utilisation = hp_costs = hp_workload = 0.0;
+  all_decided = TRUE;
+  for (first = 0; first < no_tasks[current_system]; first = last) {
+    level_utilisation = level_costs = level_workload = 0.0;
+    for (last = first; (last < no_tasks[current_system]) &&
+	   (priorities[order[last]] == priorities[order[first]]); last++) {
+      task = order[last];
+      base = kernel_base(kernel, task, current_system);
+      if (deadline_variable[current_system] != INVALID)
+	deadline = variables[current_system][deadline_variable[current_system]][task];
+      else
+	deadline = periods[task];
+
+      if (hp_utilisation < 1.0) {
+	bound = (base + hp_workload) / (1.0 - hp_utilisation);
+	if (bound <= deadline) {
+	  verdicts[current_system][task] = SCHEDULABLE;
+	  verdict_tests[current_system][task] = UPPER_BOUND_TEST;
+	  verdict_bounds[current_system][task] = bound;
+	}
+      }
+      if ((verdicts[current_system][task] == UNDECIDED) && (base > 0.0)) {
+	if (hp_utilisation >= 1.0) {
+	  verdicts[current_system][task] = UNSCHEDULABLE;
+	  verdict_tests[current_system][task] = LOWER_BOUND_TEST;
+	  verdict_bounds[current_system][task] = MAXDOUBLE;
+	}
+	else if (base + hp_costs > deadline) {
+	  verdicts[current_system][task] = UNSCHEDULABLE;
+	  verdict_tests[current_system][task] = LOWER_BOUND_TEST;
+	  verdict_bounds[current_system][task] = base + hp_costs;
+	}
+      }
+      if (verdicts[current_system][task] == UNDECIDED)
+	all_decided = FALSE;
+
+      task_utilisation = costs[task] / periods[task];
+      level_utilisation += task_utilisation;
+      level_costs += costs[task];
+      level_workload += costs[task] * (1.0 - task_utilisation);
+      if (jitters != NULL)
+	level_workload += jitters[task] * task_utilisation;
+    }
+    hp_utilisation += level_utilisation;
+    hp_costs += level_costs;
+    hp_workload += level_workload;
+  }
+  return(all_decided);
+}
+
+/* PRIORITY_ORDER
+
+   Fills 'order' with the task indexes of a system, sorted from the
+   highest priority (lowest priority value) to the lowest. Tasks with
+   equal priorities keep their declaration order. Without a priority
+   variable, the declaration order is used.
+*/
+
+void priority_order(int current_system, int *order)
+{
+  int merged[MAX_TASKS];
+  int width, first, middle, last, left, right, counter;
+  double *priorities;
+
+  for (counter = 0; counter < no_tasks[current_system]; counter++)
+    order[counter] = counter;
+  if (priority_variable[current_system] == INVALID)
+    return;
+  priorities = variables[current_system][priority_variable[current_system]];
+
+  /* A bottom-up merge sort, which is stable */
+
+  for (width = 1; width < no_tasks[current_system]; width *= 2) {
+    for (first = 0; first < no_tasks[current_system]; first += 2 * width) {
+      middle = first + width;
+      if (middle > no_tasks[current_system])
+	middle = no_tasks[current_system];
+      last = first + 2 * width;
+      if (last > no_tasks[current_system])
+	last = no_tasks[current_system];
+      left = first;
+      right = middle;
+      for (counter = first; counter < last; counter++)
+	if ((left < middle) &&
+	    ((right == last) || (priorities[order[left]] <= priorities[order[right]])))
+	  merged[counter] = order[left++];
+	else
+	  merged[counter] = order[right++];
+    }
+    for (counter = 0; counter < no_tasks[current_system]; counter++)
+      order[counter] = merged[counter];
+  }
+}
+
+/* EVALUATION_ORDER
+
+   Decides the order in which the I-indexed formulas of a system go
+   through the tasks. Normally that is the declaration order. With -p,
+   tasks are evaluated from the highest priority to the lowest, since a
+   task usually reads the results of the tasks above it, which are then
+   final in the same pass. Without a priority variable, the tasks that
+   the I-indexed formulas refer to by name come first.
+*/
+
+void evaluation_order(int current_system)
+{
+  int referenced[MAX_TASKS];
+  int current_formula, counter, task;
+  formula_t position;
+
+  if (priority_ordered && (priority_variable[current_system] != INVALID)) {
+    priority_order(current_system, task_order[current_system]);
+    return;
+  }
+
+  for (task = 0; task < no_tasks[current_system]; task++)
+    referenced[task] = FALSE;
+  if (priority_ordered)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+      if (formulas[current_system][current_formula]->func_field.definition.index_type == I_INDEX)
+	for (position = formulas[current_system][current_formula]; position != NULL; position = position->next)
+	  if ((match_local_variable(position, SINGLE_INDEX, current_system) != INVALID) &&
+	      check_task(field_task_name(position, current_system), current_system))
+	    referenced[get_task_index(field_task_name(position, current_system), current_system)] = TRUE;
+
+  counter = 0;
+  for (task = 0; task < no_tasks[current_system]; task++)
+    if (referenced[task])
+      task_order[current_system][counter++] = task;
+  for (task = 0; task < no_tasks[current_system]; task++)
+    if (!referenced[task])
+      task_order[current_system][counter++] = task;
+}
+
+/* OUTPUT_VERDICTS
+
+   Prints the schedulability verdict of every task of a system (-s).
+   Tasks that the sufficient tests couldn't decide are judged on the
+   result of the exact analysis.
+*/
+
+void output_verdicts(int current_system)
+{
+  int task, response_var, limit_var;
+  double response, deadline;
+
+  if ((verdict_formula[current_system] == INVALID) ||
+      ((limit_var = deadline_limit(current_system, verdict_formula[current_system])) == INVALID)) {
+    output_results(current_system);
+    printf("\nNo response time formula and deadline to give verdicts for.\n");
+    return;
+  }
+  response_var = get_variable_index(result_name(formulas[current_system][verdict_formula[current_system]], current_system), current_system);
+
+  printf("\n\nSystem '%s'\n", system_names[current_system]);
+  printf("-------------------\n\n");
+  if (utilisation_test[current_system])
+    printf("Utilisation %f, Liu & Layland bound %f, hyperbolic product %f\n\n",
+	   utilisation[current_system],
+	   no_tasks[current_system] * (pow(2.0, 1.0 / no_tasks[current_system]) - 1.0),
+	   hyperbolic_product[current_system]);
+
+  for (task = 0; task < no_tasks[current_system]; task++) {
+    deadline = variables[current_system][limit_var][task];
+    printf("%s[%s]: ", variable_names[current_system][response_var], task_names[current_system][task]);
+    if (verdicts[current_system][task] == UNDECIDED) {
+      response = variables[current_system][response_var][task];
+      printf("%s (response time %f, deadline %f)\n",
+	     (response <= deadline) ? "schedulable" : "unschedulable", response, deadline);
+    }
+    else if (verdict_tests[current_system][task] == UTILISATION_TEST)
+      printf("schedulable (utilisation bound)\n");
+    else if (verdict_tests[current_system][task] == UPPER_BOUND_TEST)
+      printf("schedulable (response time at most %f, deadline %f)\n",
+	     verdict_bounds[current_system][task], deadline);
+    else if (verdict_bounds[current_system][task] == MAXDOUBLE)
+      printf("unschedulable (higher priority utilisation of 1 or more)\n");
+    else
+      printf("unschedulable (response time at least %f, deadline %f)\n",
+	     verdict_bounds[current_system][task], deadline);
+  }
+}
+
+/* FIND_RESPONSE_FORMULA
+
+   Returns the formula that computes the response times of a system:
+   the kernel formula whose result is the variable inside its ceiling,
+   or else the last formula with a local result indexed by `i'.
+   Returns INVALID if there is no such formula.
+*/
+
+int find_response_formula(int current_system)
+{
+  int current_formula, response_formula;
+  char *result_var_name;
+
+  response_formula = INVALID;
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+    result_var_name = result_name(formulas[current_system][current_formula], current_system);
+    if ((formulas[current_system][current_formula]->func_field.definition.index_type != I_INDEX) ||
+	(formulas[current_system][current_formula]->func_field.definition.column_type != INVALID) ||
+	!check_variable(result_var_name, current_system))
+      continue;
+    if ((kernels[current_system][current_formula] != NULL) &&
+	(kernels[current_system][current_formula]->response_variable == get_variable_index(result_var_name, current_system)))
+      return(current_formula);
+    response_formula = current_formula;
+  }
+  return(response_formula);
+}
+
+/* DEADLINE_LIMIT
+
+   Returns the variable holding the deadlines that the result of a
+   response time formula is compared with: the declared deadline
+   variable, or the periods of a kernel formula. Returns INVALID if
+   there is neither.
+*/
+
+int deadline_limit(int current_system, int response_formula)
+{
+  if (deadline_variable[current_system] != INVALID)
+    return(deadline_variable[current_system]);
+  else if (kernels[current_system][response_formula] != NULL)
+    return(kernels[current_system][response_formula]->period_variable);
+  else
+    return(INVALID);
+}
+
+/* FORMULA_WRITES
+
+   Checks if a local variable is the result of one of the formulas of
+   a system. With 'variable_index' INVALID, checks if any formula of the
+   system has a global result.
+*/
+
+int formula_writes(int current_system, int variable_index)
+{
+  int current_formula;
+  char *result_var_name;
+
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+    result_var_name = result_name(formulas[current_system][current_formula], current_system);
+    if (!check_variable(result_var_name, current_system)) {
+      if (variable_index == INVALID)
+	return(TRUE);
+    }
+    else if (get_variable_index(result_var_name, current_system) == variable_index)
+      return(TRUE);
+  }
+  return(FALSE);
+}
+
+/* CLONE_SYSTEM
+
+   Copies a system into another slot, normally one of the scratch
+   systems after the real ones. The formulas are shared. The workers
+   of the parallel modes each get their own scratch system, since the
+   evaluation only touches the data of the system it works on.
+*/
+
+void clone_system(int source, int destination)
+{
+  int counter;
+
+  memcpy(variables[destination], variables[source], sizeof(variables[source]));
+  memcpy(backup_vars[destination], backup_vars[source], sizeof(backup_vars[source]));
+  memcpy(semaphores[destination], semaphores[source], sizeof(semaphores[source]));
+  memcpy(matrix_elements[destination], matrix_elements[source], matrix_size[source] * sizeof(double));
+  memcpy(backup_matrix_elements[destination], backup_matrix_elements[source], matrix_size[source] * sizeof(double));
+  memcpy(matrix_offset[destination], matrix_offset[source], sizeof(matrix_offset[source]));
+  matrix_size[destination] = matrix_size[source];
+  memcpy(variable_types[destination], variable_types[source], sizeof(variable_types[source]));
+  memcpy(system_names[destination], system_names[source], sizeof(system_names[source]));
+  memcpy(variable_names[destination], variable_names[source], sizeof(variable_names[source]));
+  memcpy(task_names[destination], task_names[source], sizeof(task_names[source]));
+  memcpy(semaphore_names[destination], semaphore_names[source], sizeof(semaphore_names[source]));
+  memcpy(formulas[destination], formulas[source], sizeof(formulas[source]));
+  memcpy(kernels[destination], kernels[source], sizeof(kernels[source]));
+  memcpy(affine[destination], affine[source], sizeof(affine[source]));
+  memcpy(reads[destination], reads[source], sizeof(reads[source]));
+  no_inner_sums[destination] = no_inner_sums[source];
+  for (counter = 0; counter < no_inner_sums[source]; counter++) {
+    inner_sums[destination][counter].sigma = inner_sums[source][counter].sigma;
+    inner_sums[destination][counter].reads = inner_sums[source][counter].reads;
+  }
+  memcpy(ceiling[destination], ceiling[source], sizeof(ceiling[source]));
+  stack_pointer[destination] = 0;
+  priority_variable[destination] = priority_variable[source];
+  blocking_variable[destination] = blocking_variable[source];
+  deadline_variable[destination] = deadline_variable[source];
+  no_tasks[destination] = no_tasks[source];
+  no_vars[destination] = no_vars[source];
+  no_semaphores[destination] = no_semaphores[source];
+  no_formulas[destination] = no_formulas[source];
+  dynamic_blocking[destination] = dynamic_blocking[source];
+  blocking[destination] = blocking[source];
+  only_task[destination] = INVALID;
+  cutoff_variable[destination] = INVALID;
+  cutoff_task[destination] = INVALID;
+  deadline_missed[destination] = FALSE;
+  touch_system(destination);
+}
+
+/* RESET_SYSTEM
+
+   Restores the initial values of all variables of a system, except
+   the priorities
+*/
+
+void reset_system(int current_system)
+{
+  int var_counter, counter;
+
+  for (var_counter = 0; var_counter < no_vars[current_system]; var_counter++)
+    if (var_counter != priority_variable[current_system])
+      for (counter = 0; counter < no_tasks[current_system]; counter++)
+	variables[current_system][var_counter][counter] = backup_vars[current_system][var_counter][counter];
+  memcpy(matrix_elements[current_system], backup_matrix_elements[current_system], matrix_size[current_system] * sizeof(double));
+  touch_system(current_system);
+}
+
+/* AUDSLEY
+
+   Optimal priority assignment (-a). Starting with the lowest priority,
+   each level is given to a task that is schedulable there, assuming
+   that all tasks without a priority yet have higher priorities. The
+   candidates of a level are tested in parallel (-j). A task that was
+   schedulable at some level stays schedulable at all higher levels,
+   since it can only get fewer higher priority tasks, so it is picked
+   at the next level without being tested again.
+
+   The levels are written into the priority variable as 1 (highest) to
+   the number of tasks. If no feasible assignment exists, the original
+   priorities are kept. Returns TRUE if an assignment was found.
+*/
+
+int audsley(int current_system)
+{
+  struct audsley_job job;
+  pthread_t workers[MAX_WORKERS];
+  int known_schedulable[MAX_TASKS], assigned[MAX_TASKS];
+  double original_priorities[MAX_TASKS];
+  int level, task, counter, chosen, no_workers, priority_var;
+
+  priority_var = priority_variable[current_system];
+  if (priority_var == INVALID)
+    return(FALSE);
+  job.response_formula = find_response_formula(current_system);
+  if ((job.response_formula == INVALID) ||
+      ((job.limit_variable = deadline_limit(current_system, job.response_formula)) == INVALID)) {
+    fprintf(stderr, "System `%s': priority assignment needs a response time formula and a deadline variable.\n", system_names[current_system]);
+    exit(-1);
+  }
+  if (formula_writes(current_system, priority_var)) {
+    fprintf(stderr, "System `%s': priority assignment can't be used with dynamic priorities.\n", system_names[current_system]);
+    exit(-1);
+  }
+  job.system = current_system;
+  job.response_variable = get_variable_index(result_name(formulas[current_system][job.response_formula], current_system), current_system);
+  job.own_elements = own_elements(current_system);
+  pthread_mutex_init(&job.lock, NULL);
+
+  for (task = 0; task < no_tasks[current_system]; task++) {
+    known_schedulable[task] = FALSE;
+    assigned[task] = FALSE;
+    original_priorities[task] = variables[current_system][priority_var][task];
+  }
+
+  for (level = no_tasks[current_system]; level > 0; level--) {
+    chosen = INVALID;
+    for (task = 0; (task < no_tasks[current_system]) && (chosen == INVALID); task++)
+      if (!assigned[task] && known_schedulable[task])
+	chosen = task;
+
+    if (chosen == INVALID) {
+      job.level = level;
+      job.no_candidates = 0;
+      for (task = 0; task < no_tasks[current_system]; task++)
+	if (!assigned[task])
+	  job.candidates[job.no_candidates++] = task;
+      job.next_candidate = 0;
+      job.next_slot = MAX_SYSTEMS;
+
+      /* Formulas with global results can't be run side by side */
+
+      no_workers = threads;
+      if (no_workers > job.no_candidates)
+	no_workers = job.no_candidates;
+      if (formula_writes(current_system, INVALID))
+	no_workers = 1;
+
+      if (no_workers == 1)
+	audsley_worker(&job);
+      else {
+	for (counter = 0; counter < no_workers; counter++)
+	  if (pthread_create(&workers[counter], NULL, audsley_worker, &job) != 0) {
+	    fprintf(stderr, "Failed to start worker thread.\n");
+	    exit(-1);
+	  }
+	for (counter = 0; counter < no_workers; counter++)
+	  pthread_join(workers[counter], NULL);
+      }
+
+      for (counter = 0; counter < job.no_candidates; counter++)
+	if (job.schedulable[counter]) {
+	  known_schedulable[job.candidates[counter]] = TRUE;
+	  if (chosen == INVALID)
+	    chosen = job.candidates[counter];
+	}
+    }
+
+    if (chosen == INVALID) {
+      printf("\nSystem `%s': no feasible priority assignment, no task is schedulable at level %d.\n", system_names[current_system], level);
+      for (task = 0; task < no_tasks[current_system]; task++)
+	variables[current_system][priority_var][task] = original_priorities[task];
+      touch_system(current_system);
+      pthread_mutex_destroy(&job.lock);
+      return(FALSE);
+    }
+    assigned[chosen] = TRUE;
+    variables[current_system][priority_var][chosen] = level;
+  }
+
+  for (task = 0; task < no_tasks[current_system]; task++)
+    backup_vars[current_system][priority_var][task] = variables[current_system][priority_var][task];
+  touch_system(current_system);
+  if (blocking[current_system])
+    calculate_blocking(current_system);
+  pthread_mutex_destroy(&job.lock);
+
+  printf("\nPriorities of system `%s' assigned by Audsley's algorithm:\n", system_names[current_system]);
+  for (task = 0; task < no_tasks[current_system]; task++)
+    printf("%s[%s] = %f\n", variable_names[current_system][priority_var], task_names[current_system][task], variables[current_system][priority_var][task]);
+  return(TRUE);
+}
+
+/* AUDSLEY_WORKER
+
+   Takes a scratch system and tests candidates of the current level
+   until there are no more
+*/
+
+void *audsley_worker(void *argument)
+{
+  struct audsley_job *job;
+  int slot, candidate;
+
+  job = argument;
+  pthread_mutex_lock(&job->lock);
+  slot = job->next_slot++;
+  pthread_mutex_unlock(&job->lock);
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    candidate = job->next_candidate++;
+    pthread_mutex_unlock(&job->lock);
+    if (candidate >= job->no_candidates)
+      break;
+    job->schedulable[candidate] = test_candidate(job, slot, job->candidates[candidate]);
+  }
+  return(NULL);
+}
+
+/* TEST_CANDIDATE
+
+   Checks if a task meets its deadline at the level of the job, with
+   the other tasks without a priority above it. If own_elements allows
+   it, only the elements of the task itself are calculated, and the
+   calculation stops as soon as its deadline is passed. The global
+   results the test writes are put back afterwards (such systems are
+   tested one candidate at a time).
+*/
+
+int test_candidate(struct audsley_job *job, int slot, int task)
+{
+  int counter, priority_var, global_results, schedulable;
+
+  global_results = formula_writes(job->system, INVALID);
+  if (global_results)
+    memcpy(job->globals, global_variables, sizeof(global_variables));
+  clone_system(job->system, slot);
+  reset_system(slot);
+  priority_var = priority_variable[slot];
+  for (counter = 0; counter < job->no_candidates; counter++)
+    variables[slot][priority_var][job->candidates[counter]] = 0.0;
+  variables[slot][priority_var][task] = job->level;
+  if (blocking[slot])
+    calculate_blocking(slot);
+
+  only_task[slot] = job->own_elements ? task : INVALID;
+  cutoff_variable[slot] = job->response_variable;
+  cutoff_limit[slot] = job->limit_variable;
+  cutoff_task[slot] = task;
+  calculate_task_set(slot);
+
+  schedulable = !deadline_missed[slot] &&
+    (variables[slot][job->response_variable][task] <= variables[slot][job->limit_variable][task]);
+  if (global_results) {
+    memcpy(global_variables, job->globals, sizeof(global_variables));
+    touch_globals();
+  }
+  return(schedulable);
+}
+
+/* OWN_ELEMENTS
+
+   Checks that the elements of one task of the I-indexed local results
+   can be calculated without those of the other tasks: nothing reads
+   another element of these results, and only I-indexed local formulas
+   read them at all. Otherwise test_candidate calculates all tasks.
+*/
+
+int own_elements(int current_system)
+{
+  int current_formula, other_formula, read;
+  formula_t reader, writer;
+
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+    reader = formulas[current_system][current_formula];
+    if (reads[current_system][current_formula].untracked)
+      return(FALSE);
+    for (read = 0; read < reads[current_system][current_formula].no_reads; read++) {
+      if (reads[current_system][current_formula].global[read])
+	continue;
+      for (other_formula = 0; other_formula < no_formulas[current_system]; other_formula++) {
+	writer = formulas[current_system][other_formula];
+	if ((writer->func_field.definition.index_type != I_INDEX) ||
+	    (writer->func_field.definition.column_type != INVALID) ||
+	    !check_variable(result_name(writer, current_system), current_system) ||
+	    (get_variable_index(result_name(writer, current_system), current_system) !=
+	     reads[current_system][current_formula].variable[read]))
+	  continue;
+	if ((reads[current_system][current_formula].index_type[read] != I_INDEX) ||
+	    (reader->func_field.definition.index_type != I_INDEX) ||
+	    (reader->func_field.definition.column_type != INVALID) ||
+	    !check_variable(result_name(reader, current_system), current_system))
+	  return(FALSE);
+      }
+    }
+  }
+  return(TRUE);
+}
+
+/* SENSITIVITY
+
+   Finds how much an indexed variable, normally the execution times,
+   can be scaled before a deadline is missed (--sensitivity): for each
+   task on its own, and for all tasks together (the critical scaling
+   factor). Every search is a binary search over the factor, and the
+   searches are run in parallel (-j).
+*/
+
+void sensitivity(int current_system, char *variable_name)
+{
+  struct sensitivity_job job;
+  pthread_t workers[MAX_WORKERS];
+  int response_formula, current_formula, task, counter, no_workers;
+  double value;
+
+  job.system = current_system;
+  job.variable = get_variable_index(variable_name, current_system);
+  response_formula = find_response_formula(current_system);
+  if ((response_formula == INVALID) ||
+      ((job.limit_variable = deadline_limit(current_system, response_formula)) == INVALID)) {
+    fprintf(stderr, "System `%s': sensitivity analysis needs a response time formula and a deadline variable.\n", system_names[current_system]);
+    exit(-1);
+  }
+  if (variable_types[current_system][job.variable] != INDEXED_VAR) {
+    fprintf(stderr, "System `%s': `%s' must be an indexed variable for sensitivity analysis.\n", system_names[current_system], variable_name);
+    exit(-1);
+  }
+  if (formula_writes(current_system, job.variable)) {
+    fprintf(stderr, "System `%s': `%s' is calculated, it can't be scaled.\n", system_names[current_system], variable_name);
+    exit(-1);
+  }
+  job.response_variable = get_variable_index(result_name(formulas[current_system][response_formula], current_system), current_system);
+
+  /* If the response times only grow with the variable, a probe can
+     start from the fixed point of a smaller, schedulable factor. That
+     is known for the costs of the standard response time analysis. */
+
+  job.warm_start = (kernels[current_system][response_formula] != NULL) &&
+    (kernels[current_system][response_formula]->cost_variable == job.variable);
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+    if (kernels[current_system][current_formula] == NULL)
+      job.warm_start = FALSE;
+  for (task = 0; task < no_tasks[current_system]; task++)
+    if (!(backup_vars[current_system][job.variable][task] >= 0.0))
+      job.warm_start = FALSE;
+
+  job.no_searches = 0;
+  job.tasks[job.no_searches++] = INVALID;
+  for (task = 0; task < no_tasks[current_system]; task++)
+    job.tasks[job.no_searches++] = task;
+  job.next_search = 0;
+  job.next_slot = MAX_SYSTEMS;
+  pthread_mutex_init(&job.lock, NULL);
+
+  /* Formulas with global results can't be run side by side */
+
+  no_workers = threads;
+  if (no_workers > job.no_searches)
+    no_workers = job.no_searches;
+  if (formula_writes(current_system, INVALID))
+    no_workers = 1;
+
+  if (no_workers == 1)
+    sensitivity_worker(&job);
+  else {
+    for (counter = 0; counter < no_workers; counter++)
+      if (pthread_create(&workers[counter], NULL, sensitivity_worker, &job) != 0) {
+	fprintf(stderr, "Failed to start worker thread.\n");
+	exit(-1);
+      }
+    for (counter = 0; counter < no_workers; counter++)
+      pthread_join(workers[counter], NULL);
+  }
+  pthread_mutex_destroy(&job.lock);
+
+  printf("\n\nSensitivity of `%s' in system '%s'\n", variable_name, system_names[current_system]);
+  printf("-------------------\n\n");
+  for (counter = 0; counter < job.no_searches; counter++) {
+    task = job.tasks[counter];
+    if (task == INVALID)
+      printf("All tasks: ");
+    else
+      printf("%s[%s] = %f: ", variable_name, task_names[current_system][task], backup_vars[current_system][job.variable][task]);
+    if (job.factors[counter] < 0.0)
+      printf("unschedulable at any value\n");
+    else if (job.factors[counter] == MAXDOUBLE)
+      printf("schedulable up to factor %f and beyond\n", MAX_FACTOR);
+    else if (task == INVALID)
+      printf("critical scaling factor %f\n", job.factors[counter]);
+    else {
+      value = backup_vars[current_system][job.variable][task] * job.factors[counter];
+      printf("factor %f, up to %f (margin %f)\n", job.factors[counter], value,
+	     value - backup_vars[current_system][job.variable][task]);
+    }
+  }
+}
+
+/* SENSITIVITY_WORKER
+
+   Takes a scratch system and runs searches until there are no more
+*/
+
+void *sensitivity_worker(void *argument)
+{
+  struct sensitivity_job *job;
+  int slot, search;
+
+  job = argument;
+  pthread_mutex_lock(&job->lock);
+  slot = job->next_slot++;
+  pthread_mutex_unlock(&job->lock);
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    search = job->next_search++;
+    pthread_mutex_unlock(&job->lock);
+    if (search >= job->no_searches)
+      break;
+    job->factors[search] = critical_factor(job, slot, job->tasks[search]);
+  }
+  return(NULL);
+}
+
+/* CRITICAL_FACTOR
+
+   Returns the largest factor for the variable of one task (or of all
+   tasks) that keeps the system schedulable, to a relative precision
+   of FACTOR_PRECISION. Returns MAXDOUBLE if even MAX_FACTOR is fine,
+   and -1 if not even 0 is.
+*/
+
+double critical_factor(struct sensitivity_job *job, int slot, int task)
+{
+  double warm[MAX_TASKS];
+  double lower, upper, middle;
+  int warm_valid;
+
+  warm_valid = FALSE;
+  if (probe(job, slot, task, 1.0, warm, &warm_valid)) {
+    lower = 1.0;
+    for (upper = 2.0; probe(job, slot, task, upper, warm, &warm_valid); upper *= 2.0) {
+      lower = upper;
+      if (upper >= MAX_FACTOR)
+	return(MAXDOUBLE);
+    }
+  }
+  else {
+    if (!probe(job, slot, task, 0.0, warm, &warm_valid))
+      return(-1.0);
+    lower = 0.0;
+    upper = 1.0;
+  }
+
+  while (upper - lower > FACTOR_PRECISION * upper) {
+    middle = (lower + upper) / 2.0;
+    if (probe(job, slot, task, middle, warm, &warm_valid))
+      lower = middle;
+    else
+      upper = middle;
+  }
+  return(lower);
+}
+
+/* PROBE
+
+   Checks if the system meets all deadlines with the variable of one
+   task (or of all tasks) scaled by a factor. The calculation stops as
+   soon as a deadline is passed. With warm starts, the response times
+   start from 'warm', the fixed point of the largest schedulable factor
+   so far, which is below the new fixed point, and a schedulable probe
+   leaves its fixed point there.
+*/
+
+int probe(struct sensitivity_job *job, int slot, int task, double factor, double *warm, int *warm_valid)
+{
+  int counter, schedulable;
+
+  clone_system(job->system, slot);
+  reset_system(slot);
+  for (counter = 0; counter < no_tasks[slot]; counter++)
+    if ((task == INVALID) || (counter == task))
+      variables[slot][job->variable][counter] = backup_vars[slot][job->variable][counter] * factor;
+  if (blocking[slot])
+    calculate_blocking(slot);
+  if (job->warm_start && *warm_valid)
+    for (counter = 0; counter < no_tasks[slot]; counter++)
+      variables[slot][job->response_variable][counter] = warm[counter];
+
+  cutoff_variable[slot] = job->response_variable;
+  cutoff_limit[slot] = job->limit_variable;
+  calculate_task_set(slot);
+
+  schedulable = !deadline_missed[slot];
+  for (counter = 0; counter < no_tasks[slot]; counter++)
+    if (variables[slot][job->response_variable][counter] > variables[slot][job->limit_variable][counter])
+      schedulable = FALSE;
+  if (schedulable) {
+    for (counter = 0; counter < no_tasks[slot]; counter++)
+      warm[counter] = variables[slot][job->response_variable][counter];
+    *warm_valid = TRUE;
+  }
+  return(schedulable);
+}
+
+/* CAMPAIGN
+
+   Runs a randomised schedulability campaign (--campaign) with a system
+   of the input as the template: its formulas, its tasks and the values
+   of all variables other than the periods, costs, priorities and
+   deadlines, which are generated. For each utilisation in the range,
+   the given number of task sets is drawn with UUniFast-Discard and
+   periods that are log-uniform in a range or taken from a list, with
+   rate monotonic priorities and deadlines equal to the periods. Every
+   set has its own random sequence, so the results don't depend on the
+   number of threads. Prints the ratio of schedulable sets and the
+   analysis times for each utilisation.
+*/
+
+void campaign(int current_system)
+{
+  static struct campaign_worker workers[MAX_WORKERS];
+  pthread_t threads_started[MAX_WORKERS];
+  struct campaign_job job;
+  rta_kernel_t kernel;
+  char *position, *end;
+  long schedulable;
+  int response_formula, point, counter, no_workers;
+  double total_time, longest_time, started, seconds;
+
+  response_formula = find_response_formula(current_system);
+  kernel = (response_formula != INVALID) ? kernels[current_system][response_formula] : NULL;
+  if ((kernel == NULL) || (priority_variable[current_system] == INVALID)) {
+    fprintf(stderr, "System `%s': a campaign needs a response time formula of the form\nR[i] = C[i] + ... + sigma(hp, ceiling((R[i]+J[j])/T[j])*C[j]);\n", system_names[current_system]);
+    exit(-1);
+  }
+  job.system = current_system;
+  job.response_variable = get_variable_index(result_name(formulas[current_system][response_formula], current_system), current_system);
+  job.period_variable = kernel->period_variable;
+  job.cost_variable = kernel->cost_variable;
+  job.limit_variable = deadline_limit(current_system, response_formula);
+
+  job.sets = campaign_sets;
+  job.first_utilisation = utilisation_range[0];
+  job.utilisation_step = utilisation_range[2];
+  job.no_points = (int) floor((utilisation_range[1] - utilisation_range[0]) / utilisation_range[2] + 1e-9) + 1;
+  if (job.no_points > MAX_POINTS) {
+    fprintf(stderr, "A campaign can have at most %d utilisations.\n", MAX_POINTS);
+    exit(-1);
+  }
+
+  /* No task can have a utilisation above 1, so UUniFast-Discard would
+     never finish above the number of tasks */
+
+  if (no_tasks[current_system] < 1) {
+    fprintf(stderr, "System `%s': a campaign needs at least one task.\n", system_names[current_system]);
+    exit(-1);
+  }
+  if (job.first_utilisation + (job.no_points - 1) * job.utilisation_step > no_tasks[current_system] + 1e-9) {
+    fprintf(stderr, "System `%s': the utilisation can't be above %d, the number of tasks.\n",
+	    system_names[current_system], no_tasks[current_system]);
+    exit(-1);
+  }
+  job.seed = campaign_seed;
+
+  job.no_periods = 0;
+  if (strchr(period_spec, ':') != NULL) {
+    if ((sscanf(period_spec, "%lf:%lf", &job.period_min, &job.period_max) != 2) ||
+	(job.period_min <= 0.0) || (job.period_max < job.period_min)) {
+      fprintf(stderr, "Bad period range `%s'.\n", period_spec);
+      exit(-1);
+    }
+  }
+  else
+    for (position = period_spec; *position != '\0'; position = (*end == ',') ? end + 1 : end) {
+      if (job.no_periods == MAX_PERIODS) {
+	fprintf(stderr, "At most %d periods can be listed.\n", MAX_PERIODS);
+	exit(-1);
+      }
+      job.periods[job.no_periods] = strtod(position, &end);
+      if ((end == position) || (job.periods[job.no_periods] <= 0.0)) {
+	fprintf(stderr, "Bad period list `%s'.\n", period_spec);
+	exit(-1);
+      }
+      job.no_periods++;
+    }
+
+  job.no_sets = (long) job.no_points * job.sets;
+  job.next_set = 0;
+  pthread_mutex_init(&job.lock, NULL);
+
+  /* Formulas with global results can't be run side by side */
+
+  no_workers = threads;
+  if (formula_writes(current_system, INVALID))
+    no_workers = 1;
+  for (counter = 0; counter < no_workers; counter++) {
+    memset(&workers[counter], 0, sizeof(struct campaign_worker));
+    workers[counter].job = &job;
+    workers[counter].slot = MAX_SYSTEMS + counter;
+  }
+
+  started = now();
+  if (no_workers == 1)
+    campaign_worker(&workers[0]);
+  else {
+    for (counter = 0; counter < no_workers; counter++)
+      if (pthread_create(&threads_started[counter], NULL, campaign_worker, &workers[counter]) != 0) {
+	fprintf(stderr, "Failed to start worker thread.\n");
+	exit(-1);
+      }
+    for (counter = 0; counter < no_workers; counter++)
+      pthread_join(threads_started[counter], NULL);
+  }
+  seconds = now() - started;
+  pthread_mutex_destroy(&job.lock);
+
+  printf("\n\nCampaign on system '%s': %d task sets of %d tasks per utilisation, seed %llu\n",
+	 system_names[current_system], job.sets, no_tasks[current_system], job.seed);
+  printf("-------------------\n\n");
+  printf("Utilisation  Schedulable  Ratio     Mean time (us)  Max time (us)\n");
+  for (point = 0; point < job.no_points; point++) {
+    schedulable = 0;
+    total_time = longest_time = 0.0;
+    for (counter = 0; counter < no_workers; counter++) {
+      schedulable += workers[counter].schedulable[point];
+      total_time += workers[counter].total_time[point];
+      longest_time = max(longest_time, workers[counter].longest_time[point]);
+    }
+    printf("%f     %-11ld  %f  %-14.1f  %.1f\n", job.first_utilisation + point * job.utilisation_step,
+	   schedulable, (double) schedulable / job.sets, total_time / job.sets * 1e6, longest_time * 1e6);
+  }
+  printf("\n%ld task sets in %f s (%.0f per second) with %d thread(s)\n",
+	 job.no_sets, seconds, (seconds > 0.0) ? job.no_sets / seconds : 0.0, no_workers);
+}
+
+/* CAMPAIGN_WORKER
+
+   Takes chunks of task sets and analyses them on its own scratch
+   system
+*/
+
+void *campaign_worker(void *argument)
+{
+  struct campaign_worker *worker;
+  struct campaign_job *job;
+  long set, first, last;
+  int point;
+  double started, time;
+
+  worker = argument;
+  job = worker->job;
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    first = job->next_set;
+    job->next_set += CAMPAIGN_CHUNK;
+    pthread_mutex_unlock(&job->lock);
+    if (first >= job->no_sets)
+      break;
+    last = min(first + CAMPAIGN_CHUNK, job->no_sets);
+
+    for (set = first; set < last; set++) {
+      point = set / job->sets;
+      started = now();
+      worker->schedulable[point] += analyse_random_set(job, worker->slot, set);
+      time = now() - started;
+      worker->total_time[point] += time;
+      worker->longest_time[point] = max(worker->longest_time[point], time);
+    }
+  }
+  return(NULL);
+}
+
+/* ANALYSE_RANDOM_SET
+
+   Generates task set number 'set' of a campaign in a scratch system
+   and returns TRUE if it is schedulable
+*/
+
+int analyse_random_set(struct campaign_job *job, int slot, long set)
+{
+  double shares[MAX_TASKS];
+  double utilisation, remaining, next, logarithm;
+  unsigned long long state;
+  int task, other, rank, n, discard;
+  double *periods;
+
+  clone_system(job->system, slot);
+  reset_system(slot);
+  n = no_tasks[slot];
+  utilisation = job->first_utilisation + (set / job->sets) * job->utilisation_step;
+  state = job->seed * 0x9E3779B97F4A7C15ULL + (unsigned long long) set;
+
+  /* UUniFast, repeated until no task has a utilisation above 1. At a
+     utilisation of n that leaves only one set, which it won't draw */
+
+  if (utilisation > n - 1e-9) {
+    for (task = 0; task < n; task++)
+      shares[task] = utilisation / n;
+  }
+  else do {
+    remaining = utilisation;
+    for (task = 0; task < n - 1; task++) {
+      next = remaining * pow(next_random(&state), 1.0 / (n - task - 1));
+      shares[task] = remaining - next;
+      remaining = next;
+    }
+    shares[n - 1] = remaining;
+    discard = FALSE;
+    for (task = 0; task < n; task++)
+      if (shares[task] > 1.0)
+	discard = TRUE;
+  } while (discard);
+
+  periods = variables[slot][job->period_variable];
+  for (task = 0; task < n; task++) {
+    if (job->no_periods > 0)
+      periods[task] = job->periods[(int) (next_random(&state) * job->no_periods)];
+    else {
+      logarithm = log(job->period_min) + next_random(&state) * (log(job->period_max) - log(job->period_min));
+      periods[task] = exp(logarithm);
+      if (job->period_min >= 1.0)
+	periods[task] = floor(periods[task] + 0.5);
+    }
+    variables[slot][job->cost_variable][task] = shares[task] * periods[task];
+    if (deadline_variable[slot] != INVALID)
+      variables[slot][deadline_variable[slot]][task] = periods[task];
+  }
+
+  /* Rate monotonic priorities, ties broken by the task order */
+
+  for (task = 0; task < n; task++) {
+    rank = 1;
+    for (other = 0; other < n; other++)
+      if ((periods[other] < periods[task]) || ((periods[other] == periods[task]) && (other < task)))
+	rank++;
+    variables[slot][priority_variable[slot]][task] = rank;
+  }
+  if (blocking[slot])
+    calculate_blocking(slot);
+
+  cutoff_variable[slot] = job->response_variable;
+  cutoff_limit[slot] = job->limit_variable;
+  calculate_task_set(slot);
+  if (deadline_missed[slot])
+    return(FALSE);
+  for (task = 0; task < n; task++)
+    if (variables[slot][job->response_variable][task] > variables[slot][job->limit_variable][task])
+      return(FALSE);
+  return(TRUE);
+}
+
+/* Returns a random number in [0, 1) from a SplitMix64 sequence */
+
+double next_random(unsigned long long *state)
+{
+  unsigned long long value;
+
+  value = (*state += 0x9E3779B97F4A7C15ULL);
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+  value = value ^ (value >> 31);
+  return((value >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/* INITIALISE
+
+   Initialises the program with the model of a parsed context, or with
+   the model saved in model_input. The formulas of an earlier model are
+   freed first; the scratch systems only share them.
+*/
+
+int initialise(struct build_context *context)
+{
+  struct model_section sections[MAX_SECTIONS];
+  int no_systems, no_sections, counter, counter2, counter3; /* Intuitive variable names */
+
+  /* Starts from zeroes, also after the end of the names of an earlier
+     model, so that the same model always has the same cache_key */
+
+  no_sections = model_sections(MAX_SYSTEMS, sections);
+  for (counter = 0; counter < no_sections; counter++)
+    memset(sections[counter].data, 0, sections[counter].size);
+
+  for (counter = 0; counter < MAX_SLOTS; counter++) {
+    for (counter2 = 0; counter2 < MAX_FORMULAS; counter2++) {
+      if (counter < MAX_SYSTEMS) {
+	if (formulas_allocated)
+	  free_formula(counter, counter2);
+	free(kernels[counter][counter2]);
+      }
+      formulas[counter][counter2] = NULL;
+      kernels[counter][counter2] = NULL;
+    }
+    if (counter < MAX_SYSTEMS)
+      converged[counter] = FALSE;
+    for (counter2 = 0; counter2 < MAX_VARIABLES; counter2++)
+      for (counter3 = 0; counter3 < MAX_TASKS; counter3++) {
+	variables[counter][counter2][counter3] = 0.0;
+	backup_vars[counter][counter2][counter3] = 0.0;
+      }
+    for (counter2 = 0; counter2 < MAX_VARIABLES; counter2++)
+      matrix_offset[counter][counter2] = INVALID;
+    matrix_size[counter] = 0;
+    blocking_variable[counter] = INVALID;
+    priority_variable[counter] = INVALID;
+    deadline_variable[counter] = INVALID;
+    only_task[counter] = INVALID;
+    cutoff_variable[counter] = INVALID;
+    cutoff_task[counter] = INVALID;
+    blocking[counter] = FALSE;
+    no_formulas[counter] = 0;
+    no_tasks[counter] = 0;
+    no_vars[counter] = 0;
+    no_semaphores[counter] = 0;
+    touch_system(counter);
+  }
+  touch_globals();
+
+  for (counter2 = 0; counter2 < MAX_VARIABLES; counter2++)
+    for (counter3 = 0; counter3 < MAX_TASKS; counter3++) {
+      global_variables[counter2][counter3] = 0.0;
+      global_backup_vars[counter2][counter3] = 0.0;
+    }
+  no_global_variables = 0;
+  no_global_tasks = 0;
+
+  for (counter = 0;counter < MAX_SLOTS; counter++)
+    for (counter2 = 0;counter2 < MAX_SEMAPHORES;counter2++)
+      for (counter3 = 0;counter3 < MAX_TASKS;counter3++)
+	semaphores[counter][counter2][counter3] = INVALID;
+
+  formulas_allocated = (model_input == NULL);
+  if (model_input != NULL)
+    no_systems = load_model(model_input);
+  else {
+    no_systems = build_model(context);
+    for (counter = 0; counter < no_systems; counter++) {
+      for (counter2 = 0; counter2 < no_vars[counter]; counter2++)
+	if (variable_types[counter][counter2] == MATRIX_VAR)
+	  place_matrix(counter, counter2);
+      if (blocking[counter]) {
+	calculate_blocking(counter);
+	dynamic_blocking[counter] = check_dynamic_blocking(counter);
+      }
+      else if (blocking_variable[counter] != INVALID) {
+	fprintf(stderr, "System `%s':\nBlocking factor variable declared, but no semaphores found.\n", system_names[counter]);
+	exit(-1);
+      }
+    }
+    share_formulas(no_systems);
+  }
+  compile_kernels(no_systems);
+  compile_affine(no_systems);
+  collect_reads(no_systems);
+  collect_inner_sums(no_systems);
+
+  return(no_systems);
+}
+
+/* MODEL_SECTIONS
+
+   Lists the arrays that make up a parsed model, for save_model and
+   load_model. Only the slots of the systems in use are included.
+*/
+
+int model_sections(int no_systems, struct model_section *sections)
+{
+  int no_sections;
+
+  no_sections = 0;
+  add_section(sections, &no_sections, variables, no_systems * sizeof(variables[0]));
+  add_section(sections, &no_sections, backup_vars, no_systems * sizeof(backup_vars[0]));
+  add_section(sections, &no_sections, semaphores, no_systems * sizeof(semaphores[0]));
+  add_section(sections, &no_sections, matrix_elements, no_systems * sizeof(matrix_elements[0]));
+  add_section(sections, &no_sections, backup_matrix_elements, no_systems * sizeof(backup_matrix_elements[0]));
+  add_section(sections, &no_sections, matrix_offset, no_systems * sizeof(matrix_offset[0]));
+  add_section(sections, &no_sections, matrix_size, no_systems * sizeof(int));
+  add_section(sections, &no_sections, variable_types, no_systems * sizeof(variable_types[0]));
+  add_section(sections, &no_sections, system_names, no_systems * sizeof(system_names[0]));
+  add_section(sections, &no_sections, variable_names, no_systems * sizeof(variable_names[0]));
+  add_section(sections, &no_sections, task_names, no_systems * sizeof(task_names[0]));
+  add_section(sections, &no_sections, semaphore_names, no_systems * sizeof(semaphore_names[0]));
+  add_section(sections, &no_sections, ceiling, no_systems * sizeof(ceiling[0]));
+  add_section(sections, &no_sections, priority_variable, no_systems * sizeof(int));
+  add_section(sections, &no_sections, blocking_variable, no_systems * sizeof(int));
+  add_section(sections, &no_sections, deadline_variable, no_systems * sizeof(int));
+  add_section(sections, &no_sections, no_tasks, no_systems * sizeof(int));
+  add_section(sections, &no_sections, no_vars, no_systems * sizeof(int));
+  add_section(sections, &no_sections, no_semaphores, no_systems * sizeof(int));
+  add_section(sections, &no_sections, no_formulas, no_systems * sizeof(int));
+  add_section(sections, &no_sections, dynamic_blocking, no_systems * sizeof(int));
+  add_section(sections, &no_sections, blocking, no_systems * sizeof(int));
+  add_section(sections, &no_sections, base_system, no_systems * sizeof(int));
+  add_section(sections, &no_sections, global_variable_names, sizeof(global_variable_names));
+  add_section(sections, &no_sections, global_task_names, sizeof(global_task_names));
+  add_section(sections, &no_sections, global_variable_types, sizeof(global_variable_types));
+  add_section(sections, &no_sections, global_variables, sizeof(global_variables));
+  add_section(sections, &no_sections, global_backup_vars, sizeof(global_backup_vars));
+  add_section(sections, &no_sections, &no_global_variables, sizeof(int));
+  add_section(sections, &no_sections, &no_global_tasks, sizeof(int));
+  return(no_sections);
+}
+
+void add_section(struct model_section *sections, int *no_sections, void *data, size_t size)
+{
+  if (*no_sections == MAX_SECTIONS) {
+    fprintf(stderr, "Bad error: Too many model sections.\n");
+    exit(-1);
+  }
+  sections[*no_sections].data = data;
+  sections[*no_sections].size = size;
+  ++*no_sections;
+}
+
+/* MODEL_HEADER
+
+   Fills in the header of a precompiled model. Besides the version of
+   the format, it holds everything that decides the layout of the
+   data, so that a file from an incompatible build is refused.
+*/
+
+void model_header(struct model_header *header, int no_systems, int no_fields)
+{
+  memset(header, 0, sizeof(struct model_header));
+  memcpy(header->magic, MODEL_MAGIC, sizeof(header->magic));
+  header->version = MODEL_VERSION;
+  header->byte_order = 0x01020304;
+  header->sizes[0] = MAX_VARIABLES;
+  header->sizes[1] = MAX_TASKS;
+  header->sizes[2] = MAX_SEMAPHORES;
+  header->sizes[3] = MAX_FORMULAS;
+  header->sizes[4] = STRING_SIZE;
+  header->sizes[5] = sizeof(struct formula);
+  header->sizes[6] = sizeof(double);
+  header->sizes[7] = sizeof(formula_t);
+  header->no_systems = no_systems;
+  header->no_fields = no_fields;
+}
+
+/* SAVE_MODEL
+
+   Writes the parsed model to a file (--compile), so that it can be
+   loaded again with load_model without parsing. The file consists
+   of the header, the arrays listed by model_sections, the index of
+   the first field of each formula and all formula fields. Each part
+   starts at a multiple of 8 bytes. The fields of a formula are stored
+   one after the other, and their 'next' pointers only tell whether
+   another field follows.
+*/
+
+void save_model(char *file_name, int no_systems)
+{
+  FILE *file;
+  struct model_header header;
+  struct model_section sections[MAX_SECTIONS];
+  int heads[MAX_SYSTEMS][MAX_FORMULAS];
+  struct formula field;
+  formula_t position;
+  int no_sections, no_fields, counter, current_system, current_formula;
+
+  no_fields = 0;
+  for (current_system = 0; current_system < no_systems; current_system++)
+    for (current_formula = 0; current_formula < MAX_FORMULAS; current_formula++) {
+      heads[current_system][current_formula] = INVALID;
+      if (current_formula < no_formulas[current_system]) {
+	if (shared_head(heads, current_system, current_formula) != INVALID) {
+	  heads[current_system][current_formula] = shared_head(heads, current_system, current_formula);
+	  continue;
+	}
+	heads[current_system][current_formula] = no_fields;
+	for (position = formulas[current_system][current_formula]; position != NULL; position = position->next)
+	  no_fields++;
+      }
+    }
+
+  file = fopen(file_name, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Can't create `%s'.\n", file_name);
+    exit(-1);
+  }
+
+  model_header(&header, no_systems, no_fields);
+  write_section(file, &header, sizeof(header));
+  no_sections = model_sections(no_systems, sections);
+  for (counter = 0; counter < no_sections; counter++)
+    write_section(file, sections[counter].data, sections[counter].size);
+  write_section(file, heads, no_systems * sizeof(heads[0]));
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      if (shared_head(heads, current_system, current_formula) != INVALID)
+	continue;
+      for (position = formulas[current_system][current_formula]; position != NULL; position = position->next) {
+	field = *position;
+	field.next = (position->next != NULL) ? &field : NULL;
+	write_section(file, &field, sizeof(field));
+      }
+    }
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Failed to write `%s'.\n", file_name);
+    exit(-1);
+  }
+}
+
+/* SHARED_HEAD
+
+   Returns the head of an earlier formula that shares its fields with
+   a formula, or INVALID if the formula is the first to use them. The
+   shared formulas are written once, and share them again when the
+   model is loaded.
+*/
+
+int shared_head(int heads[][MAX_FORMULAS], int current_system, int current_formula)
+{
+  int counter, counter2;
+
+  for (counter = 0; counter <= current_system; counter++)
+    for (counter2 = 0; counter2 < ((counter < current_system) ? no_formulas[counter] : current_formula); counter2++)
+      if (formulas[counter][counter2] == formulas[current_system][current_formula])
+	return(heads[counter][counter2]);
+  return(INVALID);
+}
+
+void write_section(FILE *file, void *data, size_t size)
+{
+  static char padding[8];
+
+  if ((fwrite(data, 1, size, file) != size) ||
+      (fwrite(padding, 1, ALIGNED(size) - size, file) != ALIGNED(size) - size)) {
+    fprintf(stderr, "Failed to write precompiled model.\n");
+    exit(-1);
+  }
+}
+
+/* LOAD_MODEL
+
+   Loads a model written by save_model (--load). The file is mapped
+   into memory, the arrays are copied into place and the formula
+   fields are used where they are in the mapping, after pointing
+   their 'next' fields to the following field. Returns the number of
+   systems.
+*/
+
+int load_model(char *file_name)
+{
+  struct model_header header, expected;
+  struct model_section sections[MAX_SECTIONS];
+  int heads[MAX_SYSTEMS][MAX_FORMULAS];
+  struct stat status;
+  formula_t fields;
+  char *map;
+  size_t size, offset;
+  int file, no_sections, counter, current_system, current_formula, damaged;
+
+  file = open(file_name, O_RDONLY);
+  if ((file < 0) || (fstat(file, &status) != 0)) {
+    fprintf(stderr, "Can't open `%s'.\n", file_name);
+    exit(-1);
+  }
+  size = status.st_size;
+  if (size < sizeof(header)) {
+    fprintf(stderr, "`%s' is not a precompiled model.\n", file_name);
+    exit(-1);
+  }
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+  close(file);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Can't map `%s'.\n", file_name);
+    exit(-1);
+  }
+
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, MODEL_MAGIC, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "`%s' is not a precompiled model.\n", file_name);
+    exit(-1);
+  }
+  model_header(&expected, header.no_systems, header.no_fields);
+  if ((memcmp(&header, &expected, sizeof(header)) != 0) ||
+      (header.no_systems < 0) || (header.no_systems > MAX_SYSTEMS) || (header.no_fields < 0)) {
+    fprintf(stderr, "`%s' was compiled by an incompatible version of fpscalc.\n", file_name);
+    exit(-1);
+  }
+
+  offset = ALIGNED(sizeof(header));
+  no_sections = model_sections(header.no_systems, sections);
+  for (counter = 0; counter < no_sections; counter++)
+    offset += ALIGNED(sections[counter].size);
+  if (offset + ALIGNED(header.no_systems * sizeof(heads[0])) + header.no_fields * ALIGNED(sizeof(struct formula)) != size) {
+    fprintf(stderr, "`%s' is damaged.\n", file_name);
+    exit(-1);
+  }
+
+  offset = ALIGNED(sizeof(header));
+  for (counter = 0; counter < no_sections; counter++) {
+    memcpy(sections[counter].data, map + offset, sections[counter].size);
+    offset += ALIGNED(sections[counter].size);
+  }
+  memcpy(heads, map + offset, header.no_systems * sizeof(heads[0]));
+  offset += ALIGNED(header.no_systems * sizeof(heads[0]));
+
+  /* The counts are used as indices from here on, so a damaged file
+     must not get past this */
+
+  damaged = (no_global_variables < 0) || (no_global_variables > MAX_VARIABLES) ||
+    (no_global_tasks < 0) || (no_global_tasks > MAX_TASKS);
+  for (current_system = 0; current_system < header.no_systems; current_system++)
+    if ((no_formulas[current_system] < 0) || (no_formulas[current_system] > MAX_FORMULAS) ||
+	(no_tasks[current_system] < 0) || (no_tasks[current_system] > MAX_TASKS) ||
+	(no_vars[current_system] < 0) || (no_vars[current_system] > MAX_VARIABLES) ||
+	(no_semaphores[current_system] < 0) || (no_semaphores[current_system] > MAX_SEMAPHORES) ||
+	(matrix_size[current_system] < 0) || (matrix_size[current_system] > MAX_MATRIX_ELEMENTS) ||
+	(priority_variable[current_system] < INVALID) || (priority_variable[current_system] >= no_vars[current_system]) ||
+	(blocking_variable[current_system] < INVALID) || (blocking_variable[current_system] >= no_vars[current_system]) ||
+	(deadline_variable[current_system] < INVALID) || (deadline_variable[current_system] >= no_vars[current_system]) ||
+	(base_system[current_system] < INVALID) || (base_system[current_system] >= header.no_systems))
+      damaged = TRUE;
+  if (damaged || damaged_tables(header.no_systems)) {
+    fprintf(stderr, "`%s' is damaged.\n", file_name);
+    exit(-1);
+  }
+
+  fields = (formula_t) (map + offset);
+  for (counter = 0; counter < header.no_fields; counter++)
+    if (fields[counter].next != NULL) {
+      if (counter + 1 == header.no_fields) {
+	fprintf(stderr, "`%s' is damaged.\n", file_name);
+	exit(-1);
+      }
+      fields[counter].next = &fields[counter + 1];
+    }
+  for (current_system = 0; current_system < header.no_systems; current_system++)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      if ((heads[current_system][current_formula] < 0) ||
+	  (heads[current_system][current_formula] >= header.no_fields)) {
+	fprintf(stderr, "`%s' is damaged.\n", file_name);
+	exit(-1);
+      }
+      formulas[current_system][current_formula] = &fields[heads[current_system][current_formula]];
+      if (damaged_formula(formulas[current_system][current_formula], current_system)) {
+	fprintf(stderr, "`%s' is damaged.\n", file_name);
+	exit(-1);
+      }
+    }
+
+  return(header.no_systems);
+}
+
+/* DAMAGED_TABLES
+
+   Checks the tables of a loaded model whose counts are known to be in
+   range: the names must end within their room, the types must be
+   known, and the matrices must lie within the elements of their
+   system. Returns TRUE if something is wrong.
+*/
+
+int damaged_tables(int no_systems)
+{
+  int current_system, counter, size;
+
+  for (counter = 0; counter < no_global_variables; counter++)
+    if ((memchr(global_variable_names[counter], '\0', STRING_SIZE) == NULL) ||
+	(global_variable_types[counter] < INDEXED_VAR) || (global_variable_types[counter] > MATRIX_VAR))
+      return(TRUE);
+  for (counter = 0; counter < no_global_tasks; counter++)
+    if (memchr(global_task_names[counter], '\0', STRING_SIZE) == NULL)
+      return(TRUE);
+
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    if (memchr(system_names[current_system], '\0', STRING_SIZE) == NULL)
+      return(TRUE);
+    for (counter = 0; counter < no_tasks[current_system]; counter++)
+      if (memchr(task_names[current_system][counter], '\0', STRING_SIZE) == NULL)
+	return(TRUE);
+    for (counter = 0; counter < no_semaphores[current_system]; counter++)
+      if (memchr(semaphore_names[current_system][counter], '\0', STRING_SIZE) == NULL)
+	return(TRUE);
+    size = no_tasks[current_system] * no_tasks[current_system];
+    for (counter = 0; counter < no_vars[current_system]; counter++)
+      if ((memchr(variable_names[current_system][counter], '\0', STRING_SIZE) == NULL) ||
+	  (variable_types[current_system][counter] < INDEXED_VAR) || (variable_types[current_system][counter] > MATRIX_VAR) ||
+	  ((variable_types[current_system][counter] == MATRIX_VAR) &&
+	   ((matrix_offset[current_system][counter] < 0) ||
+	    (matrix_offset[current_system][counter] > matrix_size[current_system] - size))))
+	return(TRUE);
+  }
+  return(FALSE);
+}
+
+/* DAMAGED_FORMULA
+
+   Checks the fields of a formula of a loaded model: a definition
+   first and only there, known field types, operations and indices,
+   names that end within their room, and variables and tasks (see
+   resolve_formula) that exist in the system. An element of a matrix
+   must be read from a matrix of the system. Returns TRUE if something
+   is wrong.
+*/
+
+int damaged_formula(formula_t position, int current_system)
+{
+  int variable, global, task, column, index_type, column_type, matrix;
+  formula_t head;
+
+  head = position;
+  if (head->field_type != DEF_FIELD)
+    return(TRUE);
+  for (; position != NULL; position = position->next) {
+    switch (position->field_type)
+      {
+      case DEF_FIELD :
+	if ((position != head) ||
+	    (memchr(position->func_field.definition.result_variable, '\0', sizeof(position->func_field.definition.result_variable)) == NULL) ||
+	    (memchr(position->func_field.definition.result_index_task, '\0', sizeof(position->func_field.definition.result_index_task)) == NULL))
+	  return(TRUE);
+	variable = position->func_field.definition.variable;
+	global = position->func_field.definition.global;
+	task = position->func_field.definition.task;
+	column = INVALID;
+	index_type = position->func_field.definition.index_type;
+	column_type = position->func_field.definition.column_type;
+	if (((index_type != SINGLE_INDEX) && (index_type != I_INDEX) && (index_type != SCALAR)) ||
+	    ((column_type != INVALID) && (column_type != J_INDEX)))
+	  return(TRUE);
+	break;
+
+      case VAR_FIELD :
+	if ((memchr(position->func_field.op_field.var_field.variable_name, '\0', sizeof(position->func_field.op_field.var_field.variable_name)) == NULL) ||
+	    (memchr(position->func_field.op_field.var_field.variable_index_task, '\0', sizeof(position->func_field.op_field.var_field.variable_index_task)) == NULL) ||
+	    (memchr(position->func_field.op_field.var_field.column_task, '\0', sizeof(position->func_field.op_field.var_field.column_task)) == NULL))
+	  return(TRUE);
+	variable = position->func_field.op_field.var_field.variable;
+	global = position->func_field.op_field.var_field.global;
+	task = position->func_field.op_field.var_field.task;
+	column = position->func_field.op_field.var_field.column;
+	index_type = position->func_field.op_field.var_field.index_type;
+	column_type = position->func_field.op_field.var_field.column_type;
+	if ((index_type < SINGLE_INDEX) || (index_type > K_INDEX) ||
+	    (column_type < INVALID) || (column_type > K_INDEX) || (column_type == SCALAR))
+	  return(TRUE);
+	break;
+
+      case OP_FIELD :
+	if ((position->func_field.op_field.operation < PLUS_OP) || (position->func_field.op_field.operation > END_SIGMA_OP))
+	  return(TRUE);
+	continue;
+
+      case CONST_FIELD :
+	continue;
+
+      default :
+	return(TRUE);
+      }
+
+    if ((global != FALSE) && (global != TRUE))
+      return(TRUE);
+    if (global ? ((variable < 0) || (variable >= no_global_variables)) : ((variable < 0) || (variable >= no_vars[current_system])))
+      return(TRUE);
+    if ((index_type == SINGLE_INDEX) &&
+	((task < 0) || (task >= (global ? no_global_tasks : no_tasks[current_system]))))
+      return(TRUE);
+    matrix = !global && (variable_types[current_system][variable] == MATRIX_VAR);
+    if ((column_type != INVALID) != matrix)
+      return(TRUE);
+    if ((column_type == SINGLE_INDEX) && ((column < 0) || (column >= no_tasks[current_system])))
+      return(TRUE);
+  }
+  return(FALSE);
+}
+
+/* CACHED_RESULTS
+
+   Looks the model up in the result cache (--cache). The results are
+   stored under cache_key, a hash of the parsed model and the options
+   that change the output. On a hit, the stored output is printed and
+   TRUE returned. Otherwise standard output goes to a file of its own
+   in the cache directory until store_results, so that fpscalc
+   processes sharing the directory never see a half written result.
+*/
+
+int cached_results(int no_systems)
+{
+  static int registered = FALSE;
+  char key[2 * sizeof(hash_t) + 1];
+  int file;
+
+  cache_key(no_systems, key);
+  snprintf(cache_file, PATH_SIZE, "%s/%s", cache_directory, key);
+  if ((file = open(cache_file, O_RDONLY)) != INVALID) {
+    copy_output(file);
+    close(file);
+    return(TRUE);
+  }
+
+  snprintf(cache_temp, PATH_SIZE, "%s/.%s.%ld", cache_directory, key, (long) getpid());
+  if ((file = open(cache_temp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == INVALID) {
+    fprintf(stderr, "Can't create `%s'.\n", cache_temp);
+    exit(-1);
+  }
+  if (!registered) {
+    atexit(release_cache);
+    registered = TRUE;
+  }
+  fflush(stdout);
+  saved_output = dup(STDOUT_FILENO);
+  dup2(file, STDOUT_FILENO);
+  close(file);
+  return(FALSE);
+}
+
+/* STORE_RESULTS
+
+   Prints the output of a model analysed with --cache and renames its
+   file to the key of the model, which replaces the file in one go.
+*/
+
+void store_results(void)
+{
+  int file, written;
+
+  written = (fflush(stdout) == 0) && (fsync(STDOUT_FILENO) == 0);
+  dup2(saved_output, STDOUT_FILENO);
+  close(saved_output);
+  saved_output = INVALID;
+
+  if ((file = open(cache_temp, O_RDONLY)) != INVALID) {
+    copy_output(file);
+    close(file);
+  }
+  if (!written || (rename(cache_temp, cache_file) != 0)) {
+    fprintf(stderr, "Failed to store the results in `%s'.\n", cache_file);
+    unlink(cache_temp);
+  }
+}
+
+/* Prints what an analysis that ended with an error had written, and
+   removes it from the cache directory */
+
+void release_cache(void)
+{
+  int file;
+
+  if (saved_output == INVALID)
+    return;
+  fflush(stdout);
+  dup2(saved_output, STDOUT_FILENO);
+  close(saved_output);
+  saved_output = INVALID;
+  if ((file = open(cache_temp, O_RDONLY)) != INVALID) {
+    copy_output(file);
+    close(file);
+  }
+  unlink(cache_temp);
+}
+
+void copy_output(int file)
+{
+  char buffer[8192];
+  ssize_t size;
+
+  while ((size = read(file, buffer, sizeof(buffer))) > 0)
+    fwrite(buffer, 1, size, stdout);
+  fflush(stdout);
+}
+
+/* CACHE_KEY
+
+   Computes the key of a parsed model in the result cache: a 128 bit
+   FNV-1a hash, in hexadecimal, of the build, the options that change
+   the output, the arrays of the model (cleared by initialise beyond
+   what the model uses) and the fields of the formulas. The number of
+   threads isn't included, as it doesn't change the results.
+*/
+
+void cache_key(int no_systems, char *key)
+{
+  struct model_section sections[MAX_SECTIONS];
+  struct model_header header;
+  unsigned char bytes[sizeof(struct formula)];
+  int options[5], no_sections, counter, current_system, current_formula;
+  formula_t position;
+  hash_t hash;
+
+  hash = ((hash_t) 0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+  model_header(&header, no_systems, 0);
+  hash = hash_bytes(hash, &header, sizeof(header));
+  hash = hash_bytes(hash, CACHE_STAMP, sizeof(CACHE_STAMP));
+
+  options[0] = verbose;
+  options[1] = verdicts_only;
+  options[2] = assign_priorities;
+  options[3] = priority_ordered;
+  options[4] = no_selected;
+  hash = hash_bytes(hash, options, sizeof(options));
+  for (counter = 0; counter < no_selected; counter++) {
+    hash = hash_bytes(hash, selected_variables[counter], strlen(selected_variables[counter]) + 1);
+    hash = hash_bytes(hash, selected_tasks[counter], strlen(selected_tasks[counter]) + 1);
+  }
+  if (sensitivity_name != NULL)
+    hash = hash_bytes(hash, sensitivity_name, strlen(sensitivity_name) + 1);
+
+  no_sections = model_sections(no_systems, sections);
+  for (counter = 0; counter < no_sections; counter++)
+    hash = hash_bytes(hash, sections[counter].data, sections[counter].size);
+
+  for (current_system = 0; current_system < no_systems; current_system++)
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      for (position = formulas[current_system][current_formula]; position != NULL; position = position->next)
+	hash = hash_bytes(hash, bytes, field_bytes(position, bytes));
+      hash = hash_bytes(hash, "", 1);
+    }
+
+  snprintf(key, 2 * sizeof(hash_t) + 1, "%016llx%016llx",
+	   (unsigned long long) (hash >> 64), (unsigned long long) hash);
+}
+
+hash_t hash_bytes(hash_t hash, void *data, size_t size)
+{
+  unsigned char *bytes;
+  hash_t prime;
+
+  prime = ((hash_t) 0x0000000001000000ULL << 64) | 0x000000000000013bULL;
+  for (bytes = data; size > 0; size--, bytes++)
+    hash = (hash ^ *bytes) * prime;
+  return(hash);
+}
+
+/* WATCH
+
+   --watch: analyses the file every time it changes. Each version is
+   compared with the last one that was analysed, system by system. The
+   converged values of the systems that weren't edited are kept, and
+   they are only calculated again if a global they read changes. An
+   edited system starts from its last converged values if that gives
+   the same result (see reuse_snapshot), and from the initial values
+   otherwise. Errors in the file are reported without ending the watch.
+
+   A change of the time of modification (to the nanosecond), the size
+   or the inode makes the file be read again, and it is only analysed
+   if what it holds changed. It is read once, and that copy is checked
+   and then built, so a save during the check can't slip in between.
+*/
+
+void watch(char *file_name)
+{
+  struct build_context context;
+  struct stat status;
+  struct timespec modified;
+  off_t size;
+  ino_t inode;
+  char *buffer;
+  size_t length;
+  hash_t contents, analysed;
+  int no_systems, current_system, counts[3], first;
+  double started;
+
+  watching = TRUE;
+  snapshot.no_systems = 0;
+  modified.tv_sec = modified.tv_nsec = 0;
+  size = -1;
+  inode = 0;
+  analysed = 0;
+  first = TRUE;
+  for (;;) {
+    if ((stat(file_name, &status) != 0) ||
+	((status.st_mtim.tv_sec == modified.tv_sec) && (status.st_mtim.tv_nsec == modified.tv_nsec) &&
+	 (status.st_size == size) && (status.st_ino == inode))) {
+      usleep(WATCH_INTERVAL);
+      continue;
+    }
+    modified = status.st_mtim;
+    size = status.st_size;
+    inode = status.st_ino;
+
+    buffer = read_file(file_name, &length);
+    if (buffer == NULL)
+      continue;
+    contents = hash_bytes(0, buffer, length);
+    if (!first && (contents == analysed)) {
+      free(buffer);
+      continue;
+    }
+    first = FALSE;
+    analysed = contents;
+
+    if (!watch_check(file_name, buffer, length)) {
+      free(buffer);
+      fprintf(stderr, "Waiting for `%s' to change.\n", file_name);
+      continue;
+    }
+    started = now();
+    open_buffer(&context, file_name, buffer, length);
+    parse_model(&context);
+    close_input(&context);
+    no_systems = initialise(&context);
+    free(buffer);
+    if (tracing)
+      for (current_system = 0; current_system < no_systems; current_system++)
+	trace_name(current_system, system_names[current_system]);
+    reuse_snapshot(no_systems, counts);
+    analyse(no_systems);
+    take_snapshot(no_systems);
+
+    if (!verbose)
+      for (current_system = 0;current_system < no_systems;current_system++)
+	output_results(current_system);
+    if (sensitivity_name != NULL)
+      for (current_system = 0; current_system < no_systems; current_system++)
+	if (check_variable(sensitivity_name, current_system))
+	  sensitivity(current_system, sensitivity_name);
+    fflush(stdout);
+    fprintf(stderr, "`%s' analysed in %.3f ms: %d systems kept, %d warm, %d cold.\n",
+	    file_name, 1000.0 * (now() - started), counts[KEPT_SYSTEM], counts[WARM_SYSTEM], counts[COLD_SYSTEM]);
+  }
+}
+
+/* WATCH_CHECK
+
+   Parses and builds the contents of the file in a child process first,
+   since errors in the input end the process. Returns TRUE if that went
+   well.
+*/
+
+int watch_check(char *file_name, char *buffer, size_t size)
+{
+  struct build_context context;
+  pid_t child;
+  int status;
+
+  fflush(stdout);
+  fflush(stderr);
+  child = fork();
+  if (child < 0)
+    return(FALSE);
+  if (child == 0) {
+    tracing = FALSE;
+    open_buffer(&context, file_name, buffer, size);
+    parse_model(&context);
+    close_input(&context);
+    initialise(&context);
+    fflush(stderr);
+    _exit(0);
+  }
+  if (waitpid(child, &status, 0) != child)
+    return(FALSE);
+  return(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
+
+/* READ_FILE
+
+   Reads a whole file into memory. Returns the contents, which are
+   freed by the caller, or NULL if the file can't be read.
+*/
+
+char *read_file(char *file_name, size_t *size)
+{
+  char *buffer, *bigger;
+  size_t room;
+  ssize_t got;
+  int file;
+
+  file = open(file_name, O_RDONLY);
+  if (file < 0)
+    return(NULL);
+  room = 8192;
+  *size = 0;
+  got = 0;
+  buffer = malloc(room);
+  while ((buffer != NULL) && ((got = read(file, buffer + *size, room - *size)) > 0)) {
+    *size += got;
+    if (*size == room) {
+      room *= 2;
+      bigger = realloc(buffer, room);
+      if (bigger == NULL)
+	free(buffer);
+      buffer = bigger;
+    }
+  }
+  close(file);
+  if ((buffer != NULL) && (got < 0)) {
+    free(buffer);
+    buffer = NULL;
+  }
+  return(buffer);
+}
+
+/* TAKE_SNAPSHOT
+
+   Keeps what the next --watch run compares with
+*/
+
+void take_snapshot(int no_systems)
+{
+  int current_system;
+
+  for (current_system = 0; current_system < snapshot.no_systems; current_system++)
+    free(snapshot.descriptions[current_system]);
+  free(snapshot.global_description);
+
+  snapshot.no_systems = no_systems;
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    strcpy(snapshot.system_names[current_system], system_names[current_system]);
+    snapshot.descriptions[current_system] = describe(current_system);
+  }
+  snapshot.global_description = describe(INVALID);
+  snapshot_values(no_systems);
+}
+
+/* Keeps only the initial and converged values, for a new run of the
+   same model */
+
+void snapshot_values(int no_systems)
+{
+  memcpy(snapshot.initial, backup_vars, no_systems * sizeof(backup_vars[0]));
+  memcpy(snapshot.values, variables, no_systems * sizeof(variables[0]));
+  memcpy(snapshot.global_initial, global_backup_vars, sizeof(global_backup_vars));
+  memcpy(snapshot.global_values, global_variables, sizeof(global_variables));
+}
+
+/* REUSE_SNAPSHOT
+
+   Decides how each system of a new version of the model starts, and
+   counts them in 'counts':
+
+   KEPT_SYSTEM: the system is declared as before, with the same initial
+   values. It keeps its converged values.
+
+   WARM_SYSTEM: only the initial values of variables that no formula
+   writes have changed, each in the direction that makes the results
+   grow (see grown), and the system is monotone (see monotone_system).
+   The fixed point can then only grow, so the iteration can go on from
+   the old one, which is below the new one, and ends up in the same
+   place as from the initial values.
+
+   COLD_SYSTEM: anything else, which starts from the initial values.
+   Systems with matrices are always cold, the snapshot doesn't hold
+   them.
+
+   A change in the global declarations or their initial values makes
+   all systems cold. The systems that read a global written by a cold
+   system are cold as well, and those that read one written by a warm
+   system are warm at best.
+*/
+
+void reuse_snapshot(int no_systems, int *counts)
+{
+  int state[MAX_SYSTEMS], old[MAX_SYSTEMS];
+  int current_system, old_system, consumer, current_formula, variable, task, globals_same, change, writers, cold_writers;
+  char *description, *result_var_name;
+
+  description = describe(INVALID);
+  globals_same = (snapshot.global_description != NULL) && (strcmp(description, snapshot.global_description) == 0) &&
+    (memcmp(global_backup_vars, snapshot.global_initial, sizeof(global_backup_vars)) == 0);
+  free(description);
+
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    state[current_system] = COLD_SYSTEM;
+    old[current_system] = INVALID;
+    for (old_system = 0; old_system < snapshot.no_systems; old_system++)
+      if (strcmp(system_names[current_system], snapshot.system_names[old_system]) == 0)
+	old[current_system] = old_system;
+    if (!globals_same || (old[current_system] == INVALID) || (matrix_size[current_system] > 0))
+      continue;
+    description = describe(current_system);
+    if (strcmp(description, snapshot.descriptions[old[current_system]]) == 0) {
+      if (memcmp(backup_vars[current_system], snapshot.initial[old[current_system]], sizeof(backup_vars[0])) == 0)
+	state[current_system] = KEPT_SYSTEM;
+      else if (grown(current_system, snapshot.initial[old[current_system]], no_tasks[current_system]) &&
+	       monotone_system(current_system))
+	state[current_system] = WARM_SYSTEM;
+    }
+    free(description);
+  }
+
+  system_dependencies(no_systems);
+  do {
+    change = FALSE;
+    for (current_system = 0; current_system < no_systems; current_system++)
+      if (state[current_system] != KEPT_SYSTEM)
+	for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+	  result_var_name = result_name(formulas[current_system][current_formula], current_system);
+	  if (check_variable(result_var_name, current_system))
+	    continue;
+	  variable = get_global_variable_index(result_var_name);
+	  for (consumer = 0; consumer < no_systems; consumer++)
+	    if ((consumer != current_system) && system_reads[consumer][variable]) {
+	      if ((state[current_system] == COLD_SYSTEM) && (state[consumer] != COLD_SYSTEM)) {
+		state[consumer] = COLD_SYSTEM;
+		change = TRUE;
+	      }
+	      else if ((state[current_system] == WARM_SYSTEM) && (state[consumer] == KEPT_SYSTEM)) {
+		state[consumer] = monotone_system(consumer) ? WARM_SYSTEM : COLD_SYSTEM;
+		change = TRUE;
+	      }
+	    }
+	}
+  } while (change);
+
+  /* Put back the converged values of the variables the formulas write */
+
+  counts[KEPT_SYSTEM] = counts[WARM_SYSTEM] = counts[COLD_SYSTEM] = 0;
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    counts[state[current_system]]++;
+    if (state[current_system] == COLD_SYSTEM)
+      continue;
+    for (variable = 0; variable < no_vars[current_system]; variable++)
+      if (formula_writes(current_system, variable))
+	for (task = 0; task < MAX_TASKS; task++)
+	  variables[current_system][variable][task] = snapshot.values[old[current_system]][variable][task];
+    converged[current_system] = (state[current_system] == KEPT_SYSTEM);
+    touch_system(current_system);
+  }
+
+  if (globals_same)
+    for (variable = 0; variable < no_global_variables; variable++) {
+      writers = cold_writers = 0;
+      for (current_system = 0; current_system < no_systems; current_system++)
+	for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+	  if (strcmp(result_name(formulas[current_system][current_formula], current_system),
+		     global_variable_names[variable]) == 0) {
+	    writers++;
+	    if (state[current_system] == COLD_SYSTEM)
+	      cold_writers++;
+	  }
+      if ((writers > 0) && (cold_writers == 0))
+	memcpy(global_variables[variable], snapshot.global_values[variable], sizeof(global_variables[0]));
+
+      /* Otherwise the global starts from its initial values, and the
+	 other writers have to write their elements of it again */
+
+      else if (cold_writers > 0)
+	for (current_system = 0; current_system < no_systems; current_system++)
+	  if (state[current_system] != COLD_SYSTEM)
+	    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++)
+	      if (strcmp(result_name(formulas[current_system][current_formula], current_system),
+			 global_variable_names[variable]) == 0)
+		converged[current_system] = FALSE;
+    }
+  touch_globals();
+}
+
+/* Checks that the initial values of the variables no formula writes
+   have only changed in the direction that makes the results grow (see
+   polarities), and that the others and the priorities are the same.
+   The tasks from no_old_tasks on are new, and not compared. */
+
+int grown(int current_system, double old_initial[][MAX_TASKS], int no_old_tasks)
+{
+  char signs[2 * MAX_VARIABLES];
+  int variable, task;
+  double value, old_value;
+
+  if (!polarities(current_system, signs))
+    return(FALSE);
+  for (variable = 0; variable < no_vars[current_system]; variable++)
+    for (task = 0; task < MAX_TASKS; task++) {
+      if ((task >= no_old_tasks) && (task < no_tasks[current_system]))
+	continue;
+      value = backup_vars[current_system][variable][task];
+      old_value = old_initial[variable][task];
+      if (value == old_value)
+	continue;
+      if ((variable == priority_variable[current_system]) || formula_writes(current_system, variable) ||
+	  (signs[variable] == (POSITIVE | NEGATIVE)) ||
+	  ((signs[variable] == POSITIVE) && (value < old_value)) ||
+	  ((signs[variable] == NEGATIVE) && (value > old_value)))
+	return(FALSE);
+    }
+  return(TRUE);
+}
+
+/* MONOTONE_SYSTEM
+
+   Checks that the results of the formulas of a system can only grow
+   when the variables they write grow: all values are non-negative,
+   the written variables (and the globals that any system writes) are
+   only read where they make the results grow, and the priorities are
+   fixed.
+*/
+
+int monotone_system(int current_system)
+{
+  char signs[2 * MAX_VARIABLES];
+  int variable, task, other_system, current_formula;
+  char *result_var_name;
+
+  if (!polarities(current_system, signs))
+    return(FALSE);
+  if ((priority_variable[current_system] != INVALID) &&
+      formula_writes(current_system, priority_variable[current_system]))
+    return(FALSE);
+  for (variable = 0; variable < no_vars[current_system]; variable++) {
+    if (formula_writes(current_system, variable) && (signs[variable] & NEGATIVE))
+      return(FALSE);
+    for (task = 0; task < MAX_TASKS; task++)
+      if (backup_vars[current_system][variable][task] < 0.0)
+	return(FALSE);
+  }
+  for (variable = 0; variable < no_global_variables; variable++)
+    for (task = 0; task < MAX_TASKS; task++)
+      if (global_backup_vars[variable][task] < 0.0)
+	return(FALSE);
+
+  for (other_system = 0; other_system < MAX_SYSTEMS; other_system++)
+    for (current_formula = 0; current_formula < no_formulas[other_system]; current_formula++) {
+      result_var_name = result_name(formulas[other_system][current_formula], other_system);
+      if (!check_variable(result_var_name, other_system) &&
+	  (signs[MAX_VARIABLES + get_global_variable_index(result_var_name)] & NEGATIVE))
+	return(FALSE);
+    }
+  return(TRUE);
+}
+
+/* POLARITIES
+
+   Finds how the formulas of a system depend on each variable, assuming
+   that all values are non-negative: POSITIVE if a result grows with
+   it, NEGATIVE if it shrinks (in a divisor), or both. signs[v] is for
+   local variable v and signs[MAX_VARIABLES + v] for global variable v.
+   Returns FALSE if the formulas subtract or negate anything, for which
+   no sign is known.
+*/
+
+int polarities(int current_system, char *signs)
+{
+  static char entries[STACK_SIZE][2 * MAX_VARIABLES];
+  formula_t position;
+  int current_formula, depth, variable;
+  char *name;
+
+  memset(signs, 0, 2 * MAX_VARIABLES);
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+    depth = 0;
+    for (position = formulas[current_system][current_formula]->next; position != NULL; position = position->next) {
+      if ((position->field_type == VAR_FIELD) || (position->field_type == CONST_FIELD)) {
+	if (depth == STACK_SIZE)
+	  return(FALSE);
+	memset(entries[depth], 0, 2 * MAX_VARIABLES);
+	if (position->field_type == CONST_FIELD) {
+	  if (position->func_field.op_field.constant < 0.0)
+	    return(FALSE);
+	}
+	else {
+	  name = field_name(position, current_system);
+	  if (check_variable(name, current_system))
+	    entries[depth][get_variable_index(name, current_system)] = POSITIVE;
+	  else
+	    entries[depth][MAX_VARIABLES + get_global_variable_index(name)] = POSITIVE;
+	}
+	depth++;
+      }
+      else if (position->field_type == OP_FIELD)
+	switch (position->func_field.op_field.operation)
+	  {
+	  case MINUS_OP :
+	  case UMINUS_OP :
+	    return(FALSE);
+	  case DIVIDE_OP :
+	    for (variable = 0; variable < 2 * MAX_VARIABLES; variable++)
+	      entries[depth - 2][variable] |= ((entries[depth - 1][variable] & POSITIVE) ? NEGATIVE : 0) |
+		((entries[depth - 1][variable] & NEGATIVE) ? POSITIVE : 0);
+	    depth--;
+	    break;
+	  case PLUS_OP :
+	  case MULTIPLY_OP :
+	  case MIN_OP :
+	  case MAX_OP :
+	    for (variable = 0; variable < 2 * MAX_VARIABLES; variable++)
+	      entries[depth - 2][variable] |= entries[depth - 1][variable];
+	    depth--;
+	    break;
+	  }
+    }
+    if (depth > 0)
+      for (variable = 0; variable < 2 * MAX_VARIABLES; variable++)
+	signs[variable] |= entries[0][variable];
+  }
+  return(TRUE);
+}
+
+/* DESCRIBE
+
+   Returns a description of the declarations and formulas of a system,
+   or of the global declarations if 'current_system' is INVALID, that
+   is equal for two versions of a model if nothing but the initial
+   values differ. The string must be freed.
+*/
+
+char *describe(int current_system)
+{
+  FILE *stream;
+  formula_t position;
+  char *text;
+  size_t size;
+  int counter, task, current_formula;
+
+  stream = open_memstream(&text, &size);
+  if (stream == NULL) {
+    fprintf(stderr, "Failed to allocate memory for --watch.\n");
+    exit(-1);
+  }
+
+  if (current_system == INVALID) {
+    for (counter = 0; counter < no_global_variables; counter++)
+      fprintf(stream, "%s %d;", global_variable_names[counter], global_variable_types[counter]);
+    for (task = 0; task < no_global_tasks; task++)
+      fprintf(stream, "%s,", global_task_names[task]);
+    fclose(stream);
+    return(text);
+  }
+
+  for (task = 0; task < no_tasks[current_system]; task++)
+    fprintf(stream, "%s,", task_names[current_system][task]);
+  for (counter = 0; counter < no_vars[current_system]; counter++)
+    fprintf(stream, "%s %d;", variable_names[current_system][counter], variable_types[current_system][counter]);
+  fprintf(stream, "%d %d %d\n", priority_variable[current_system], blocking_variable[current_system], deadline_variable[current_system]);
+  for (counter = 0; counter < no_semaphores[current_system]; counter++) {
+    fprintf(stream, "%s", semaphore_names[current_system][counter]);
+    for (task = 0; task < no_tasks[current_system]; task++)
+      fprintf(stream, " %.17g", semaphores[current_system][counter][task]);
+    fprintf(stream, "\n");
+  }
+
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+    for (position = formulas[current_system][current_formula]; position != NULL; position = position->next)
+      switch (position->field_type)
+	{
+	case DEF_FIELD :
+	  fprintf(stream, "%s %d %s %d =", result_name(position, current_system), position->func_field.definition.index_type,
+		  (position->func_field.definition.index_type == SINGLE_INDEX) ? result_task(position, current_system) : "",
+		  position->func_field.definition.column_type);
+	  break;
+	case VAR_FIELD :
+	  fprintf(stream, " %s %d %s %d %s", field_name(position, current_system), position->func_field.op_field.var_field.index_type,
+		  (position->func_field.op_field.var_field.index_type == SINGLE_INDEX) ? field_task_name(position, current_system) : "",
+		  position->func_field.op_field.var_field.column_type,
+		  (position->func_field.op_field.var_field.column_type == SINGLE_INDEX) ? column_task_name(position, current_system) : "");
+	  break;
+	case CONST_FIELD :
+	  fprintf(stream, " %.17g", position->func_field.op_field.constant);
+	  break;
+	case OP_FIELD :
+	  fprintf(stream, " op%d", position->func_field.op_field.operation);
+	  break;
+	}
+    fprintf(stream, "\n");
+  }
+  fclose(stream);
+  return(text);
+}
+
+/* SERVE
+
+   Server mode (--serve). Requests are read as one JSON object per line
+   and each gets a one line JSON reply, either on standard input and
+   output or, if a socket name is given, on the connections to a Unix
+   domain socket. Every connection is served by a process of its own,
+   so independent models are analysed concurrently. Loads and runs are
+   carried out in child processes of the connection (see serve_fork),
+   so a model that fails to load or to analyse only gets an error
+   reply. A model given with --load is loaded before any connection is
+   accepted, and then shared by all of them.
+*/
+
+void serve(char *socket_name)
+{
+  struct sockaddr_un address;
+  FILE *input, *output;
+  int listener, connection, no_systems;
+  pid_t child;
+
+  verbose = FALSE;
+  verdicts_only = FALSE;
+  no_systems = INVALID;
+  if (model_input != NULL) {
+    no_systems = initialise(NULL);
+    keep_model(no_systems);
+  }
+
+  if (socket_name == NULL) {
+    serve_session(stdin, stdout, no_systems);
+    return;
+  }
+
+  if (strlen(socket_name) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket name `%s' is too long.\n", socket_name);
+    exit(-1);
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_name);
+  unlink(socket_name);
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((listener < 0) ||
+      (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0) ||
+      (listen(listener, SOMAXCONN) != 0)) {
+    fprintf(stderr, "Can't listen on `%s': %s\n", socket_name, strerror(errno));
+    exit(-1);
+  }
+  signal(SIGCHLD, SIG_IGN);
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stderr, "Listening on `%s'\n", socket_name);
+
+  for (;;) {
+    connection = accept(listener, NULL, NULL);
+    if (connection < 0) {
+      if (errno == EINTR)
+	continue;
+      fprintf(stderr, "Can't accept a connection: %s\n", strerror(errno));
+      exit(-1);
+    }
+    child = fork();
+    if (child == 0) {
+
+      /* The trace is the server's; exit must not write it over */
+
+      tracing = FALSE;
+      signal(SIGCHLD, SIG_DFL);
+      close(listener);
+      input = fdopen(connection, "r");
+      output = fdopen(dup(connection), "w");
+      if ((input == NULL) || (output == NULL))
+	exit(-1);
+      serve_session(input, output, no_systems);
+      exit(0);
+    }
+    if (child < 0)
+      fprintf(stderr, "Can't fork: %s\n", strerror(errno));
+    close(connection);
+  }
+}
+
+/* SERVE_SESSION
+
+   Answers the requests of one client until it quits or closes the
+   connection. no_systems is the number of systems of a model that is
+   already loaded, or INVALID.
+*/
+
+void serve_session(FILE *input, FILE *output, int no_systems)
+{
+  struct session session;
+  struct request request;
+  char *line, *error;
+  size_t size;
+
+  memset(&session, 0, sizeof(session));
+  session.loaded = (no_systems != INVALID);
+  session.no_systems = no_systems;
+  session.stale = TRUE;
+  session.started = now();
+  session.results = mmap(NULL, sizeof(struct served_results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+  if (session.results == MAP_FAILED) {
+    fprintf(output, "{\"ok\":false,\"error\":\"Not enough memory\"}\n");
+    fflush(output);
+    return;
+  }
+
+  line = NULL;
+  size = 0;
+  while (!session.quit && (getline(&line, &size, input) > 0)) {
+    if (*skip_space(line) == '\0')
+      continue;
+    session.requests++;
+    error = parse_request(line, &request);
+    if (error == NULL)
+      error = serve_request(&session, &request, output);
+    if (error != NULL) {
+      fprintf(output, "{\"ok\":false,\"error\":");
+      json_string(output, error);
+      fprintf(output, "}\n");
+    }
+    fflush(output);
+  }
+  free(line);
+  munmap(session.results, sizeof(struct served_results));
+}
+
+/* KEEP_MODEL
+
+   Saves the initial values of a freshly loaded model. Updates from
+   the clients change these, and every run starts from them.
+*/
+
+void keep_model(int no_systems)
+{
+  memcpy(model_variables, backup_vars, no_systems * sizeof(backup_vars[0]));
+  memcpy(model_global_variables, global_backup_vars, sizeof(global_backup_vars));
+}
+
+/* RESTORE_MODEL
+
+   Puts back the initial values before a run, like initialise leaves
+   them, including the blocking factors.
+*/
+
+void restore_model(int no_systems)
+{
+  int current_system;
+
+  memcpy(backup_vars, model_variables, no_systems * sizeof(backup_vars[0]));
+  memcpy(variables, model_variables, no_systems * sizeof(variables[0]));
+  memcpy(global_backup_vars, model_global_variables, sizeof(global_backup_vars));
+  memcpy(global_variables, model_global_variables, sizeof(global_variables));
+  memcpy(matrix_elements, backup_matrix_elements, no_systems * sizeof(matrix_elements[0]));
+  touch_globals();
+  for (current_system = 0; current_system < no_systems; current_system++) {
+    touch_system(current_system);
+    if (blocking[current_system])
+      calculate_blocking(current_system);
+  }
+}
+
+/* SERVE_REQUEST
+
+   Carries out one request and writes the reply. Returns NULL, or an
+   error message if the request failed, in which case nothing has been
+   written.
+
+     {"command":"load","file":F}     load a model, source or --compile'd
+     {"command":"set","system":S,"variable":V,"task":T,"value":X}
+                                     change an initial value
+     {"command":"run"}               analyse with the current values
+     {"command":"get","system":S,"variable":V,"task":T}
+                                     query a result
+     {"command":"stats"}             requests served and their rate
+     {"command":"quit"}
+
+   The system can be left out for global variables, and the task for
+   scalars. An indexed variable without a task is set for all tasks,
+   and read as an object with a value per task. Results read after a
+   set without a new run are marked "stale".
+*/
+
+char *serve_request(struct session *session, struct request *request, FILE *output)
+{
+  char *error, *temp, model_file[PATH_SIZE];
+  double started, seconds, *values;
+  int current_system, variable_index, task_index, global, counter, no_task_names, errors, file, counts[3];
+  pid_t child;
+
+  if (strcmp(request->command, "load") == 0) {
+    if (session->loaded)
+      return("A model is already loaded");
+    if (request->file[0] == '\0')
+      return("Missing \"file\"");
+    if (access(request->file, R_OK) != 0) {
+      snprintf(session->message, MESSAGE_SIZE, "Can't open `%.200s'", request->file);
+      return(session->message);
+    }
+
+    /* Errors in the model end the process, so it is built in a child,
+       which hands it back as a --compile'd model */
+
+    temp = getenv("TMPDIR");
+    snprintf(model_file, PATH_SIZE, "%s/fpscalc.XXXXXX", (temp != NULL) ? temp : "/tmp");
+    file = mkstemp(model_file);
+    if (file < 0) {
+      snprintf(session->message, MESSAGE_SIZE, "Can't create `%.200s'", model_file);
+      return(session->message);
+    }
+    close(file);
+    child = serve_fork(&errors);
+    if (child == 0) {
+      session->no_systems = serve_load(request->file);
+      if (session->no_systems == INVALID) {
+	fprintf(stderr, "Can't open `%.200s'\n", request->file);
+	_exit(-1);
+      }
+      save_model(model_file, session->no_systems);
+      _exit(0);
+    }
+    if ((error = serve_wait(session, child, errors)) != NULL) {
+      unlink(model_file);
+      return(error);
+    }
+    model_input = model_file;
+    session->no_systems = initialise(NULL);
+    model_input = NULL;
+    unlink(model_file);
+    keep_model(session->no_systems);
+    session->loaded = TRUE;
+    session->stale = TRUE;
+    fprintf(output, "{\"ok\":true,\"systems\":[");
+    for (current_system = 0; current_system < session->no_systems; current_system++) {
+      if (current_system > 0)
+	fprintf(output, ",");
+      json_string(output, system_names[current_system]);
+    }
+    fprintf(output, "]}\n");
+  }
+
+  else if (strcmp(request->command, "set") == 0) {
+    if (!session->loaded)
+      return("No model loaded");
+    if (!request->has_value)
+      return("Missing \"value\"");
+    if ((error = find_target(session, request, &current_system, &variable_index, &global, &task_index)) != NULL)
+      return(error);
+    values = global ? model_global_variables[variable_index] : model_variables[current_system][variable_index];
+    if (task_index != INVALID)
+      values[task_index] = request->value;
+    else {
+      no_task_names = global ? no_global_tasks : no_tasks[current_system];
+      if ((global ? global_variable_types[variable_index] : variable_types[current_system][variable_index]) == SCALAR_VAR)
+	no_task_names = 1;
+      for (counter = 0; counter < no_task_names; counter++)
+	values[counter] = request->value;
+    }
+    session->stale = TRUE;
+    fprintf(output, "{\"ok\":true}\n");
+  }
+
+  else if (strcmp(request->command, "run") == 0) {
+    if (!session->loaded)
+      return("No model loaded");
+    started = now();
+
+    /* The analysis runs in a child as well, since a formula can fail
+       or diverge. Only the values are handed back. A run goes on from
+       the results of the last one where the new initial values allow
+       it, by the rules of --watch (see reuse_snapshot), but not with
+       -a, which changes the priorities. What the analysis prints, e.g.
+       the priorities of -a, is only kept for an error. */
+
+    child = serve_fork(&errors);
+    if (child == 0) {
+      restore_model(session->no_systems);
+      if (!assign_priorities)
+	reuse_snapshot(session->no_systems, counts);
+      analyse(session->no_systems);
+      memcpy(session->results->variables, variables, session->no_systems * sizeof(variables[0]));
+      memcpy(session->results->global_variables, global_variables, sizeof(global_variables));
+      _exit(0);
+    }
+    if ((error = serve_wait(session, child, errors)) != NULL)
+      return(error);
+    restore_model(session->no_systems);
+    memcpy(variables, session->results->variables, session->no_systems * sizeof(variables[0]));
+    memcpy(global_variables, session->results->global_variables, sizeof(global_variables));
+    if (snapshot.no_systems == 0)
+      take_snapshot(session->no_systems);
+    else
+      snapshot_values(session->no_systems);
+    session->stale = FALSE;
+    fprintf(output, "{\"ok\":true,\"seconds\":");
+    json_number(output, now() - started);
+    fprintf(output, "}\n");
+  }
+
+  else if (strcmp(request->command, "get") == 0) {
+    if (!session->loaded)
+      return("No model loaded");
+    if ((error = find_target(session, request, &current_system, &variable_index, &global, &task_index)) != NULL)
+      return(error);
+    values = global ? global_variables[variable_index] : variables[current_system][variable_index];
+    fprintf(output, "{\"ok\":true,");
+    if (session->stale)
+      fprintf(output, "\"stale\":true,");
+    if (task_index != INVALID) {
+      fprintf(output, "\"value\":");
+      json_number(output, values[task_index]);
+    }
+    else if ((global ? global_variable_types[variable_index] : variable_types[current_system][variable_index]) == SCALAR_VAR) {
+      fprintf(output, "\"value\":");
+      json_number(output, values[0]);
+    }
+    else {
+      fprintf(output, "\"values\":{");
+      no_task_names = global ? no_global_tasks : no_tasks[current_system];
+      for (counter = 0; counter < no_task_names; counter++) {
+	if (counter > 0)
+	  fprintf(output, ",");
+	json_string(output, global ? global_task_names[counter] : task_names[current_system][counter]);
+	fprintf(output, ":");
+	json_number(output, values[counter]);
+      }
+      fprintf(output, "}");
+    }
+    fprintf(output, "}\n");
+  }
+
+  else if (strcmp(request->command, "stats") == 0) {
+    seconds = now() - session->started;
+    fprintf(output, "{\"ok\":true,\"requests\":%ld,\"seconds\":", session->requests);
+    json_number(output, seconds);
+    fprintf(output, ",\"requests_per_second\":");
+    json_number(output, (seconds > 0) ? session->requests / seconds : 0);
+    fprintf(output, "}\n");
+  }
+
+  else if (strcmp(request->command, "quit") == 0) {
+    session->quit = TRUE;
+    fprintf(output, "{\"ok\":true}\n");
+  }
+
+  else {
+    snprintf(session->message, MESSAGE_SIZE, "Unknown command `%s'", request->command);
+    return(session->message);
+  }
+  return(NULL);
+}
+
+/* SERVE_LOAD
+
+   Loads a model for the server, source or --compile'd. Returns the
+   number of systems, or INVALID if the file can't be opened.
+*/
+
+int serve_load(char *file_name)
+{
+  FILE *file;
+  char magic[sizeof(MODEL_MAGIC) - 1];
+  struct build_context context;
+
+  file = fopen(file_name, "r");
+  if (file == NULL)
+    return(INVALID);
+  if ((fread(magic, 1, sizeof(magic), file) == sizeof(magic)) &&
+      (memcmp(magic, MODEL_MAGIC, sizeof(magic)) == 0)) {
+    fclose(file);
+    model_input = file_name;
+    return(initialise(NULL));
+  }
+  rewind(file);
+  open_input(&context, file_name, file);
+  parse_model(&context);
+  close_input(&context);
+  fclose(file);
+  model_input = NULL;
+  return(initialise(&context));
 }
 
-/* SIGMA_EP
+/* SERVE_FORK
 
-   Performs a summation of elements of the indexed variables with
-   the same priority (Pj) as the current task (Pi)
-   */
+   Starts a child process for a request that could end the process,
+   through an error in the model or in the analysis, so that the
+   session outlives it. Whatever the child prints goes to a pipe whose
+   other end is left in 'errors'. Returns like fork.
+*/
 
-double sigma_ep(formula_t position, int index_i, int current_system, int result_type)
+pid_t serve_fork(int *errors)
 {
-  int counter, priority_var, max_index;
-  double sigma;
+  int ends[2];
+  pid_t child;
+
+  if (pipe(ends) != 0)
+    return(-1);
+  fflush(stdout);
+  fflush(stderr);
+  child = fork();
+  if (child == 0) {
+    tracing = FALSE;
+    close(ends[0]);
+    dup2(ends[1], STDOUT_FILENO);
+    dup2(ends[1], STDERR_FILENO);
+    close(ends[1]);
+    return(0);
+  }
+  close(ends[1]);
+  if (child < 0)
+    close(ends[0]);
+  *errors = ends[0];
+  return(child);
+}
 
-  sigma = 0.0;
-  priority_var = priority_variable[current_system];
+/* SERVE_WAIT
 
-  if (result_type == GLOBAL_RESULT)
-    max_index = no_global_tasks;
-  else
-    max_index = no_tasks[current_system];
+   Waits for a child of serve_fork. Returns NULL if it went well, or
+   else the start of what it printed as the error message.
+*/
 
-  for (counter = 0;counter < max_index;counter++)
-    if (variables[current_system][priority_var][counter] == variables[current_system][priority_var][index_i])
-      sigma += parse_rpn(position->next, index_i, counter, current_system, result_type);
-  return(sigma);
+char *serve_wait(struct session *session, pid_t child, int errors)
+{
+  char buffer[BUFSIZ];
+  size_t length, part;
+  ssize_t got;
+  int status;
+
+  if (child < 0) {
+    snprintf(session->message, MESSAGE_SIZE, "Can't fork: %s", strerror(errno));
+    return(session->message);
+  }
+  length = 0;
+  while ((got = read(errors, buffer, sizeof(buffer))) != 0) {
+    if (got < 0) {
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+    part = ((size_t) got < MESSAGE_SIZE - 1 - length) ? (size_t) got : MESSAGE_SIZE - 1 - length;
+    memcpy(session->message + length, buffer, part);
+    length += part;
+  }
+  close(errors);
+  while (waitpid(child, &status, 0) < 0)
+    if (errno != EINTR) {
+      snprintf(session->message, MESSAGE_SIZE, "Lost the analysis: %s", strerror(errno));
+      return(session->message);
+    }
+  if (WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+    return(NULL);
+
+  while ((length > 0) && isspace((unsigned char) session->message[length - 1]))
+    length--;
+  session->message[length] = '\0';
+  if (length == 0) {
+    if (WIFSIGNALED(status))
+      snprintf(session->message, MESSAGE_SIZE, "The analysis was ended by signal %d", WTERMSIG(status));
+    else
+      snprintf(session->message, MESSAGE_SIZE, "The analysis failed");
+  }
+  return(session->message);
 }
 
-/* SIGMA_ALL
+/* FIND_TARGET
 
-   Performs a summation of all elements of the indexed variables
+   Looks up the variable and task named in a request. The task index
+   is INVALID if no task was given. Returns NULL, or an error message.
 */
 
-double sigma_all(formula_t position, int index_i, int current_system, int result_type)
+char *find_target(struct session *session, struct request *request,
+		  int *current_system, int *variable_index, int *global, int *task_index)
 {
-  int counter, max_index;
-  double sigma;
-
-  sigma = 0.0;
+  *current_system = INVALID;
+  *task_index = INVALID;
+  if (request->variable[0] == '\0')
+    return("Missing \"variable\"");
+  if (request->system[0] != '\0') {
+    for (*current_system = 0; *current_system < session->no_systems; ++*current_system)
+      if (strcmp(system_names[*current_system], request->system) == 0)
+	break;
+    if (*current_system == session->no_systems) {
+      snprintf(session->message, MESSAGE_SIZE, "Unknown system `%s'", request->system);
+      return(session->message);
+    }
+  }
 
-  if (result_type == GLOBAL_RESULT)
-    max_index = no_global_tasks;
-  else
-    max_index = no_tasks[current_system];
+  if ((*current_system != INVALID) && check_variable(request->variable, *current_system)) {
+    *variable_index = get_variable_index(request->variable, *current_system);
+    *global = FALSE;
+  }
+  else if (check_global_variable(request->variable)) {
+    *variable_index = get_global_variable_index(request->variable);
+    *global = TRUE;
+  }
+  else {
+    snprintf(session->message, MESSAGE_SIZE, "Unknown variable `%s'", request->variable);
+    return(session->message);
+  }
 
-  for (counter = 0;counter < max_index;counter++)
-    sigma += parse_rpn(position->next, index_i, counter, current_system, result_type);
-  return(sigma);
+  if (!*global && (variable_types[*current_system][*variable_index] == MATRIX_VAR)) {
+    snprintf(session->message, MESSAGE_SIZE, "`%s' is a matrix", request->variable);
+    return(session->message);
+  }
+  if (request->task[0] != '\0') {
+    if ((*global ? global_variable_types[*variable_index] : variable_types[*current_system][*variable_index]) != INDEXED_VAR) {
+      snprintf(session->message, MESSAGE_SIZE, "`%s' is a scalar", request->variable);
+      return(session->message);
+    }
+    if (*global ? !check_global_task(request->task) : !check_task(request->task, *current_system)) {
+      snprintf(session->message, MESSAGE_SIZE, "Unknown task `%s'", request->task);
+      return(session->message);
+    }
+    *task_index = *global ? get_global_task_index(request->task) : get_task_index(request->task, *current_system);
+  }
+  return(NULL);
 }
 
-/* INITIALISE
+/* PARSE_REQUEST
 
-   Initialises the program by parsing the input file
+   Reads a request from a flat JSON object with string members and a
+   numeric "value". Unknown members are ignored. Returns NULL, or an
+   error message.
 */
 
-int initialise(int argc,
-		char *argv[])
+char *parse_request(char *line, struct request *request)
 {
-  int no_systems, counter, counter2, counter3; /* Intuitive variable names */
-
-  for (counter = 0; counter < MAX_SYSTEMS; counter++) {
-    for (counter2 = 0; counter2 < MAX_FORMULAS; counter2++)
-      formulas[counter][counter2] = NULL;
-    for (counter2 = 0; counter2 < MAX_VARIABLES; counter2++)
-      for (counter3 = 0; counter3 < MAX_TASKS; counter3++) {
-	variables[counter][counter2][counter3] = 0.0;
-	backup_vars[counter][counter2][counter3] = 0.0;
+  char key[STRING_SIZE], ignored[PATH_SIZE], *position, *end, *target;
+  int size;
+
+  memset(request, 0, sizeof(struct request));
+  position = skip_space(line);
+  if (*position++ != '{')
+    return("Expected an object");
+  position = skip_space(position);
+  if (*position == '}')
+    position++;
+  else
+    for (;;) {
+      position = parse_string(position, key, sizeof(key));
+      if (position == NULL)
+	return("Bad member name");
+      position = skip_space(position);
+      if (*position++ != ':')
+	return("Expected `:'");
+      position = skip_space(position);
+      if (*position == '"') {
+	target = ignored;
+	size = sizeof(ignored);
+	if (strcmp(key, "command") == 0)
+	  target = request->command, size = sizeof(request->command);
+	else if (strcmp(key, "file") == 0)
+	  target = request->file, size = sizeof(request->file);
+	else if (strcmp(key, "system") == 0)
+	  target = request->system, size = sizeof(request->system);
+	else if (strcmp(key, "variable") == 0)
+	  target = request->variable, size = sizeof(request->variable);
+	else if (strcmp(key, "task") == 0)
+	  target = request->task, size = sizeof(request->task);
+	position = parse_string(position, target, size);
+	if (position == NULL)
+	  return("Bad or too long string");
       }
-    blocking_variable[counter] = INVALID;
-    priority_variable[counter] = INVALID;
-    blocking[counter] = FALSE;
-    no_formulas[counter] = 0;
-    no_tasks[counter] = 0;
-    no_vars[counter] = 0;
-    no_semaphores[counter] = 0;
-  }
-
-  for (counter2 = 0; counter2 < MAX_VARIABLES; counter2++)
-    for (counter3 = 0; counter3 < MAX_TASKS; counter3++) {
-      global_variables[counter2][counter3] = 0.0;
-      global_backup_vars[counter2][counter3] = 0.0;
+      else {
+	request->value = strtod(position, &end);
+	if (end == position)
+	  return("Expected a string or a number");
+	if (strcmp(key, "value") == 0)
+	  request->has_value = TRUE;
+	position = end;
+      }
+      position = skip_space(position);
+      if (*position == '}') {
+	position++;
+	break;
+      }
+      if (*position++ != ',')
+	return("Expected `,' or `}'");
+      position = skip_space(position);
     }
-  no_global_variables = 0;
-  no_global_tasks = 0;
+  if (*skip_space(position) != '\0')
+    return("Garbage after the object");
+  if (request->command[0] == '\0')
+    return("Missing \"command\"");
+  return(NULL);
+}
 
-  for (counter = 0;counter < MAX_SYSTEMS; counter++)
-    for (counter2 = 0;counter2 < MAX_SEMAPHORES;counter2++)
-      for (counter3 = 0;counter3 < MAX_TASKS;counter3++)
-	semaphores[counter][counter2][counter3] = INVALID;
+/* Copies a JSON string into a buffer of the given size and returns the
+   position after it, or NULL */
 
-  no_systems = yyparse();
-  for (counter = 0; counter < no_systems; counter++) {
-    if (blocking[counter]) {
-      calculate_blocking(counter);
-      dynamic_blocking[counter] = check_dynamic_blocking(counter);
-    }
-    else if (blocking_variable[counter] != INVALID) {
-      fprintf(stderr, "System `%s':\nBlocking factor variable declared, but no semaphores found.\n", system_names[counter]);
-      exit(-1);
+char *parse_string(char *position, char *buffer, int size)
+{
+  int length;
+
+  if (*position++ != '"')
+    return(NULL);
+  for (length = 0; *position != '"'; length++) {
+    if ((*position == '\0') || (length == size - 1))
+      return(NULL);
+    if (*position == '\\') {
+      switch (*++position) {
+      case 'n': buffer[length] = '\n'; break;
+      case 't': buffer[length] = '\t'; break;
+      case '"': case '\\': case '/': buffer[length] = *position; break;
+      default: return(NULL);
+      }
+      position++;
     }
+    else
+      buffer[length] = *position++;
   }
+  buffer[length] = '\0';
+  return(position + 1);
+}
 
-  return(no_systems);
+char *skip_space(char *position)
+{
+  while ((*position == ' ') || (*position == '\t') || (*position == '\r') || (*position == '\n'))
+    position++;
+  return(position);
+}
+
+void json_string(FILE *output, char *string)
+{
+  fputc('"', output);
+  for (; *string != '\0'; string++)
+    if ((*string == '"') || (*string == '\\'))
+      fprintf(output, "\\%c", *string);
+    else if ((unsigned char) *string < ' ')
+      fprintf(output, "\\u%04x", (unsigned char) *string);
+    else
+      fputc(*string, output);
+  fputc('"', output);
+}
+
+/* Numbers are written with full precision, so that the results are
+   exactly the ones of a normal run */
+
+void json_number(FILE *output, double value)
+{
+  if (isfinite(value))
+    fprintf(output, "%.17g", value);
+  else
+    fprintf(output, "null");
+}
+
+double now(void)
+{
+  struct timeval time;
+
+  gettimeofday(&time, NULL);
+  return(time.tv_sec + time.tv_usec / 1e6);
 }
 
 /* Function system_registry keeps the index of the current
-   system during parsing. */
+   system while a model is built. */
 
 int system_registry(int action)
 {
@@ -672,31 +6316,50 @@ int system_registry(int action)
 	current_system++;
       return(current_system);
     break;
+    case RESET_SYSTEMS :
+      current_system = INVALID;
+      return(current_system);
+    break;
     }
   /* Shouldn't reach this point */
   return(-1);
 }
 
 /* Function declare_system is called by the parser to define systems
-   and their specifics. */
+   and their specifics. A variant (system X extends Base) starts as a
+   copy of its base, with the same formulas, and the declarations that
+   follow add to it or override it. */
 
-void declare_system(char *system_name)
+void declare_system(char *system_name, char *base_name)
 {
-  int current_system;
+  int current_system, base;
   int counter;
 
   current_system = system_registry(GET_SYSTEM);
+  base = INVALID;
   for (counter = 0; counter <= current_system; counter++) {
     if (strcmp(system_name, system_names[counter]) == 0) {
       ceprintf("`%s' system already defined\n", system_name);
       exit(-1);
     }
+    if ((base_name != NULL) && (strcmp(base_name, system_names[counter]) == 0))
+      base = counter;
+  }
+  if ((base_name != NULL) && (base == INVALID)) {
+    ceprintf("`%s' system not previously declared\n", base_name);
+    exit(-1);
   }
   current_system = system_registry(NEXT_SYSTEM);
   if (current_system == MAX_SYSTEMS) {
     ceprintf("maximum number of systems exceeded.\n");
     exit(-1);
   }
+  if (base != INVALID) {
+    clone_system(base, current_system);
+    for (counter = 0; counter < MAX_FORMULAS; counter++)
+      inherited_formulas[counter] = (counter < no_formulas[current_system]);
+  }
+  base_system[current_system] = base;
   strcpy(system_names[current_system], system_name);
 }
 
@@ -725,6 +6388,9 @@ void declare_variable(char *variable_name, int variable_type)
   else if (variable_type == INDEXED_VAR)
     variable_types[current_system][no_vars[current_system]] = INDEXED_VAR;
 
+  else if (variable_type == MATRIX_VAR)
+    variable_types[current_system][no_vars[current_system]] = MATRIX_VAR;
+
   else if (variable_type == PRIORITY_VAR) {
     if (priority_variable[current_system] != INVALID) {
       ceprintf("`%s' priority variable already defined\n", variable_name);
@@ -735,6 +6401,16 @@ void declare_variable(char *variable_name, int variable_type)
     variable_types[current_system][no_vars[current_system]] = INDEXED_VAR;
   }
 
+  else if (variable_type == DEADLINE_VAR) {
+    if (deadline_variable[current_system] != INVALID) {
+      ceprintf("`%s' deadline variable already defined\n", variable_name);
+      exit(-1);
+    }
+    else
+      deadline_variable[current_system] = no_vars[current_system];
+    variable_types[current_system][no_vars[current_system]] = INDEXED_VAR;
+  }
+
   else if (variable_type == BLOCKING_VAR) {
     if (blocking_variable[current_system] != INVALID) {
       ceprintf("`%s' blocking variable already defined\n", variable_name);
@@ -768,7 +6444,17 @@ void init_variable(char *variable_name, char *index_task, double init_value)
     exit(-1);
   }
 
-  if (index_task == NULL) {
+  if ((init_matrix_column != NULL) || (variable_type == MATRIX_VAR)) {
+    if ((init_matrix_column == NULL) || (variable_type != MATRIX_VAR)) {
+      ceprintf("`%s' variable used as %s, but declared %s\n", variable_name,
+	       (init_matrix_column == NULL) ? "indexed" : "matrix", (variable_type == MATRIX_VAR) ? "matrix" : "indexed");
+      exit(-1);
+    }
+    init_matrix(current_system, variable_index, index_task, init_matrix_column, init_value);
+    init_matrix_column = NULL;
+  }
+
+  else if (index_task == NULL) {
 
     if (variable_type != SCALAR_VAR) {
       ceprintf("`%s' variable used as scalar, but declared indexed\n", variable_name);
@@ -826,6 +6512,75 @@ void init_variable(char *variable_name, char *index_task, double init_value)
   }
 }
 
+/* Function init_column is called by the parser before init_variable
+   when an element of a matrix is initialised, with its column: a task
+   name, or `j' for all columns. */
+
+void init_column(char *index_task)
+{
+  init_matrix_column = index_task;
+}
+
+/* INIT_MATRIX
+
+   Sets the initial value of the elements of a matrix in the given row
+   and column, either of which can be all of them (`i' and `j').
+*/
+
+void init_matrix(int current_system, int variable_index, char *row_task, char *column_task, double init_value)
+{
+  int row, column, first_row, last_row, first_column, last_column;
+
+  if (strcmp(column_task, "i") == 0) {
+    ceprintf("`i' used as the column of `%s'\n", variable_names[current_system][variable_index]);
+    exit(-1);
+  }
+  first_row = 0;
+  last_row = no_tasks[current_system] - 1;
+  if (strcmp(row_task, "i") != 0) {
+    if (!check_task(row_task, current_system)) {
+      ceprintf("`%s' task not previously declared\n", row_task);
+      exit(-1);
+    }
+    first_row = last_row = get_task_index(row_task, current_system);
+  }
+  first_column = 0;
+  last_column = no_tasks[current_system] - 1;
+  if (strcmp(column_task, "j") != 0) {
+    if (!check_task(column_task, current_system)) {
+      ceprintf("`%s' task not previously declared\n", column_task);
+      exit(-1);
+    }
+    first_column = last_column = get_task_index(column_task, current_system);
+  }
+
+  place_matrix(current_system, variable_index);
+  for (row = first_row; row <= last_row; row++)
+    for (column = first_column; column <= last_column; column++) {
+      matrix_elements[current_system][matrix_offset[current_system][variable_index] + row * no_tasks[current_system] + column] = init_value;
+      backup_matrix_elements[current_system][matrix_offset[current_system][variable_index] + row * no_tasks[current_system] + column] = init_value;
+    }
+}
+
+/* PLACE_MATRIX
+
+   Gives a matrix of a system its n * n elements in matrix_elements,
+   the first time it is used. The tasks of the system are all declared
+   by then.
+*/
+
+void place_matrix(int current_system, int variable_index)
+{
+  if (matrix_offset[current_system][variable_index] != INVALID)
+    return;
+  if (matrix_size[current_system] + no_tasks[current_system] * no_tasks[current_system] > MAX_MATRIX_ELEMENTS) {
+    ceprintf("`%s': the matrices don't fit, compile with a larger MAX_MATRIX_ELEMENTS\n", variable_names[current_system][variable_index]);
+    exit(-1);
+  }
+  matrix_offset[current_system][variable_index] = matrix_size[current_system];
+  matrix_size[current_system] += no_tasks[current_system] * no_tasks[current_system];
+}
+
 /* Function declare_task is called by the parser to set up task names
    within the system that is currently being defined. */
 
@@ -842,6 +6597,10 @@ void declare_task(char *task_name)
     ceprintf("maximum number of tasks exceeded.\n");
     exit(-1);
   }
+  if ((base_system[current_system] != INVALID) && (matrix_size[current_system] > 0)) {
+    ceprintf("`%s' task added to a variant of a system with matrices\n", task_name);
+    exit(-1);
+  }
   strcpy(task_names[current_system][no_tasks[current_system]], task_name);
   ++no_tasks[current_system];
 }
@@ -929,12 +6688,12 @@ void declare_global_variable(char *variable_name, int variable_type)
   ++no_global_variables;
 }
 
-/* Function declare_formula fills in the operands and operators
-   of a formula. 'operand' is a pointer to either the result
-   variable's name, a string containing the desired operation,
-   a constant, or the result variable's index. The action field
-   contains the sort of declaration to be performed. It can be
-   either of the following:
+/* Function declare_formula fills in the operands of a formula.
+   'operand' is a pointer to either the result variable's name, a
+   variable name, or the index of the result variable or a variable.
+   Operations and constants are added by declare_operation and
+   declare_constant. The action field contains the sort of
+   declaration to be performed. It can be either of the following:
 
    NEW_FORMULA: This will initiate the declaration of a new formula.
    operand will contain the name of the result variable.
@@ -949,21 +6708,20 @@ void declare_global_variable(char *variable_name, int variable_type)
    variable is of the standard 'indexed' type, meaning that the
    formula will execute for each element of the result variable.
 
-   FORMULA_OP: This will declare a certain operation the formula
-   should execute, such as plus, minus etc...
-
    FORMULA_VAR: This will declare a variable to be used in the
    formula.
 
-   FORMULA_CONST: This will declare a constant to be used in
-   the formula.
+   FORMULA_COLUMN: For an element of a matrix, this gives the second
+   index before FORMULA_INDEX gives the first.
+
+   Inside a summation nested in another one, the index 'k' runs over
+   the tasks of the inner summation, while 'j' is still the task of
+   the outer one. A task called k can't be named there.
 
    */
 
 void declare_formula(char *operand, int action)
 {
-  static formula_t dummy = NULL;
-  static formula_t current_formula;
   int current_system, counter, variable_type;
   char variable_name[80];
 
@@ -972,8 +6730,8 @@ void declare_formula(char *operand, int action)
   switch (action)
     {
     case NEW_FORMULA :
-      dummy = malloc(sizeof(struct formula));
-      if (dummy == NULL) {
+      last_field = calloc(1, sizeof(struct formula));
+      if (last_field == NULL) {
 	fprintf(stderr, "Failed to allocate memory for formula.\n");
 	exit(-1);
       }
@@ -988,108 +6746,42 @@ void declare_formula(char *operand, int action)
 	  exit(-1);
 	}
 
-      formulas[current_system][no_formulas[current_system]++] = dummy;
-      current_formula = dummy;
-      dummy->field_type = DEF_FIELD;
-      strcpy(dummy->func_field.definition.result_variable, operand);
-      dummy->func_field.definition.index_type = INVALID;
+      formulas[current_system][no_formulas[current_system]++] = last_field;
+      new_formula = last_field;
+      sigma_depth = 0;
+      last_field->field_type = DEF_FIELD;
+      strcpy(last_field->func_field.definition.result_variable, operand);
+      last_field->func_field.definition.index_type = INVALID;
+      last_field->func_field.definition.column_type = INVALID;
       break;
 
     case FORMULA_END :
-      dummy->next = NULL;
-      dummy = NULL; /* Get ready for the next formula definition */
-      break;
-
-    case FORMULA_OP :
-      dummy->next = malloc(sizeof(struct formula));
-      dummy = dummy->next;
-      if (dummy == NULL) {
-	fprintf(stderr, "Failed to allocate memory for formula.\n");
-	exit(-1);
-      }
-      if (strcmp(operand, "MIN") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = MIN;
-      }
-      if (strcmp(operand, "MAX") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = MAX;
-      }
-      if (strcmp(operand, "CEILING") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = CEILING;
-      }
-      else if (strcmp(operand, "FLOOR") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = FLOOR;
-      }
-      else if (strcmp(operand, "PLUS") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = PLUS;
-      }
-      else if (strcmp(operand, "MINUS") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = MINUS;
-      }
-      else if (strcmp(operand, "UMINUS") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = UMINUS;
-      }
-      else if (strcmp(operand, "MULTIPLY") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = MULTIPLY;
-      }
-      else if (strcmp(operand, "DIVIDE") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = DIVIDE;
-      }
-      else if (strcmp(operand, "SIGMA_HP") == 0) {
-	if (priority_variable[current_system] == INVALID)
-	  ceprintf("`sigma' Using prioritised summation without declaring a priority variable");
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = SIGMA_HP;
-      }
-      else if (strcmp(operand, "SIGMA_LP") == 0) {
-	if (priority_variable[current_system] == INVALID)
-	  ceprintf("`sigma' Using prioritised summation without declaring a priority variable");
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = SIGMA_LP;
-      }
-      else if (strcmp(operand, "SIGMA_EP") == 0) {
-	if (priority_variable[current_system] == INVALID)
-	  ceprintf("`sigma' Using prioritised summation without declaring a priority variable");
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = SIGMA_EP;
-      }
-      else if (strcmp(operand, "SIGMA_ALL") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = SIGMA_ALL;
-      }
-      else if (strcmp(operand, "END_SIGMA") == 0) {
-	dummy->field_type = OP_FIELD;
-	dummy->func_field.op_field.operation = END_SIGMA;
-      }
-      break;
-
-    case FORMULA_CONST :
-      dummy->next = malloc(sizeof(struct formula));
-      dummy = dummy->next;
-      if (dummy == NULL) {
-	fprintf(stderr, "Failed to allocate memory for formula.\n");
-	exit(-1);
-      }
-      dummy->field_type = CONST_FIELD;
-      dummy->func_field.op_field.constant = strtod(operand, NULL);
+      last_field->next = NULL;
+      last_field = NULL; /* Get ready for the next formula definition */
+      resolve_formula(new_formula, current_system);
+
+      /* In a variant, a formula for the same elements as one of the
+	 base takes its place. The base keeps its own. */
+
+      if (base_system[current_system] != INVALID)
+	for (counter = 0; counter < no_formulas[current_system] - 1; counter++)
+	  if (inherited_formulas[counter] &&
+	      (strcmp(formulas[current_system][counter]->func_field.definition.result_variable,
+		      new_formula->func_field.definition.result_variable) == 0) &&
+	      (formulas[current_system][counter]->func_field.definition.index_type == new_formula->func_field.definition.index_type) &&
+	      (formulas[current_system][counter]->func_field.definition.column_type == new_formula->func_field.definition.column_type) &&
+	      ((new_formula->func_field.definition.index_type != SINGLE_INDEX) ||
+	       (strcmp(formulas[current_system][counter]->func_field.definition.result_index_task,
+		       new_formula->func_field.definition.result_index_task) == 0))) {
+	    formulas[current_system][counter] = new_formula;
+	    formulas[current_system][--no_formulas[current_system]] = NULL;
+	    inherited_formulas[counter] = FALSE;
+	    break;
+	  }
       break;
 
     case FORMULA_VAR :
-      dummy->next = malloc(sizeof(struct formula));
-      dummy = dummy->next;
-      if (dummy == NULL) {
-	fprintf(stderr, "Failed to allocate memory for formula.\n");
-	exit(-1);
-      }
-      dummy->field_type = VAR_FIELD;
+      append_field(VAR_FIELD);
       counter = 0; /* Look up the variable */
       if (!check_variable(operand, current_system))
 	if (!check_global_variable(operand)) {
@@ -1097,8 +6789,36 @@ void declare_formula(char *operand, int action)
 	  exit(-1);
 	}
 
-      strcpy(dummy->func_field.op_field.var_field.variable_name, operand);
-      dummy->func_field.op_field.var_field.index_type = INVALID;
+      strcpy(last_field->func_field.op_field.var_field.variable_name, operand);
+      last_field->func_field.op_field.var_field.index_type = INVALID;
+      last_field->func_field.op_field.var_field.column_type = INVALID;
+      break;
+
+    case FORMULA_COLUMN :
+      /* Comes before FORMULA_INDEX for an element of a matrix. The
+	 result of a matrix formula X[i][j] is computed for all pairs
+	 of tasks, with `j' available as in a summation. */
+
+      if (last_field->field_type == DEF_FIELD) {
+	last_field->func_field.definition.column_type = J_INDEX;
+	sigma_depth = 1;
+	break;
+      }
+      if ((strcmp("i", operand) == 0) || (strcmp("j", operand) == 0) || ((strcmp("k", operand) == 0) && (sigma_depth == 2))) {
+	if (!check_variable(new_formula->func_field.definition.result_variable, current_system)) {
+	  ceprintf("`%s' matrix indexed by `%s' in a formula with a global result\n", last_field->func_field.op_field.var_field.variable_name, operand);
+	  exit(-1);
+	}
+	last_field->func_field.op_field.var_field.column_type = (operand[0] == 'i') ? I_INDEX : (operand[0] == 'j') ? J_INDEX : K_INDEX;
+      }
+      else {
+	if (!check_task(operand, current_system)) {
+	  ceprintf("`%s' task not previously declared\n", operand);
+	  exit(-1);
+	}
+	last_field->func_field.op_field.var_field.column_type = SINGLE_INDEX;
+	strcpy(last_field->func_field.op_field.var_field.column_task, operand);
+      }
       break;
 
     case FORMULA_INDEX :
@@ -1109,136 +6829,159 @@ void declare_formula(char *operand, int action)
 	 name (contained in operand) SCALAR is assumed to be
 	 the variable type. */
 
-      switch (dummy->field_type)
+      switch (last_field->field_type)
 	/* Tie an index to a variable. If this is the definition field
 	   (the first field of a formula), then the index concerns the
 	   result variable, and can thus be only I_INDEX, SINGLE_INDEX
 	   or SCALAR */
 	{
 	case DEF_FIELD :
-	  if (check_variable(dummy->func_field.definition.result_variable, current_system))
-	    variable_type = variable_types[current_system][get_variable_index(dummy->func_field.definition.result_variable, current_system)];
+	  if (check_variable(last_field->func_field.definition.result_variable, current_system))
+	    variable_type = variable_types[current_system][get_variable_index(last_field->func_field.definition.result_variable, current_system)];
 	  else
-	    variable_type = global_variable_types[get_global_variable_index(dummy->func_field.definition.result_variable)];
+	    variable_type = global_variable_types[get_global_variable_index(last_field->func_field.definition.result_variable)];
 
 	  if (operand == NULL) {
-	    dummy->func_field.definition.index_type = SCALAR;
+	    last_field->func_field.definition.index_type = SCALAR;
 
 	    if (variable_type != SCALAR_VAR) {
-	      ceprintf("`%s' variable used as scalar, but declared indexed\n", dummy->func_field.definition.result_variable);
+	      ceprintf("`%s' variable used as scalar, but declared indexed\n", last_field->func_field.definition.result_variable);
 	      exit(-1);
 	    }
 	  }
+	  else if (last_field->func_field.definition.column_type != INVALID) {
+	    if (variable_type != MATRIX_VAR) {
+	      ceprintf("`%s' variable used as matrix, but not declared matrix\n", last_field->func_field.definition.result_variable);
+	      exit(-1);
+	    }
+	    last_field->func_field.definition.index_type = I_INDEX;
+	    place_matrix(current_system, get_variable_index(last_field->func_field.definition.result_variable, current_system));
+	  }
 	  else {
+	    if (variable_type == MATRIX_VAR) {
+	      ceprintf("`%s' matrix used without two indices\n", last_field->func_field.definition.result_variable);
+	      exit(-1);
+	    }
 	    if (variable_type != INDEXED_VAR) {
-	      ceprintf("`%s' variable used as indexed, but declared scalar\n", dummy->func_field.definition.result_variable);
+	      ceprintf("`%s' variable used as indexed, but declared scalar\n", last_field->func_field.definition.result_variable);
 	      exit(-1);
 	    }
 
 	    if (strcmp("i", operand) == 0)
-	      dummy->func_field.definition.index_type = I_INDEX;
+	      last_field->func_field.definition.index_type = I_INDEX;
 
 	    else {
-	      dummy->func_field.definition.index_type = SINGLE_INDEX;
-	      if (check_variable(dummy->func_field.definition.result_variable, current_system)) {
+	      last_field->func_field.definition.index_type = SINGLE_INDEX;
+	      if (check_variable(last_field->func_field.definition.result_variable, current_system)) {
 		if (!check_task(operand, current_system)) {
 		  ceprintf("`%s' task not previously declared\n", operand);
 		  exit(-1);
 		}
 	      }
-	      else if (check_global_variable(dummy->func_field.definition.result_variable)) {
+	      else if (check_global_variable(last_field->func_field.definition.result_variable)) {
 		if (!check_global_task(operand)) {
 		  ceprintf("`%s' task not previously declared\n", operand);
 		  exit(-1);
 		}
 	      }
-	      strcpy(dummy->func_field.definition.result_index_task, operand);
+	      strcpy(last_field->func_field.definition.result_index_task, operand);
 	    }
 	  }
 	  break;
 
 	case VAR_FIELD :
-	  if (check_variable(dummy->func_field.op_field.var_field.variable_name, current_system)) {
-	    counter = get_variable_index(dummy->func_field.op_field.var_field.variable_name, current_system);
+	  if (check_variable(last_field->func_field.op_field.var_field.variable_name, current_system)) {
+	    counter = get_variable_index(last_field->func_field.op_field.var_field.variable_name, current_system);
 	    variable_type = variable_types[current_system][counter];
 	    strcpy(variable_name, variable_names[current_system][counter]);
 	  }
 	  else {
-	    counter = get_global_variable_index(dummy->func_field.op_field.var_field.variable_name);
+	    counter = get_global_variable_index(last_field->func_field.op_field.var_field.variable_name);
 	    variable_type = global_variable_types[counter];
 	    strcpy(variable_name, global_variable_names[counter]);
 	  }
 
+	  if ((variable_type == MATRIX_VAR) && (last_field->func_field.op_field.var_field.column_type == INVALID)) {
+	    ceprintf("`%s' matrix used without two indices\n", variable_name);
+	    exit(-1);
+	  }
+	  if ((variable_type != MATRIX_VAR) && (last_field->func_field.op_field.var_field.column_type != INVALID)) {
+	    ceprintf("`%s' variable used as matrix, but not declared matrix\n", variable_name);
+	    exit(-1);
+	  }
+	  if (variable_type == MATRIX_VAR)
+	    place_matrix(current_system, counter);
+
 	  if (operand == NULL) {
 	    if (variable_type != SCALAR_VAR) {
 	      ceprintf("`%s' variable used as scalar, but declared indexed\n", variable_name);
 	      exit(-1);
 	    }
-	    dummy->func_field.op_field.var_field.index_type = SCALAR;
+	    last_field->func_field.op_field.var_field.index_type = SCALAR;
 	  }
 	  else {
-	    if (variable_type != INDEXED_VAR) {
+	    if ((variable_type != INDEXED_VAR) && (variable_type != MATRIX_VAR)) {
 	      ceprintf("`%s' variable used as indexed, but declared scalar\n", variable_name);
 	      exit(-1);
 	    }
 
 	    if (strcmp("i", operand) == 0) {
-	      dummy->func_field.op_field.var_field.index_type = I_INDEX;
-	      if ((check_global_variable(current_formula->func_field.definition.result_variable) && check_variable(variable_name, current_system)) ||
-		  (check_global_variable(variable_name) && check_variable(current_formula->func_field.definition.result_variable, current_system))) {
+	      last_field->func_field.op_field.var_field.index_type = I_INDEX;
+	      if ((check_global_variable(new_formula->func_field.definition.result_variable) && check_variable(variable_name, current_system)) ||
+		  (check_global_variable(variable_name) && check_variable(new_formula->func_field.definition.result_variable, current_system))) {
 
 		/* This huge` if' checks if the result variable and the other variable
 		   used in the formula have a different set of indexing tasks. It should
 		   then check if these indexing tasks are the same. */
 
 		if (no_tasks[current_system] != no_global_tasks) {
-		    ceprintf("`%s' and `%s': Variables have different dimensions.\nMake sure the number of indexing tasks match.", current_formula->func_field.definition.result_variable, variable_name);
+		    ceprintf("`%s' and `%s': Variables have different dimensions.\nMake sure the number of indexing tasks match.", new_formula->func_field.definition.result_variable, variable_name);
 		    exit(-1);
 		}
 		else for (counter = 0; counter < no_tasks[current_system]; counter++)
 		  if (!check_global_task(task_names[current_system][counter])) {
-		    ceprintf("`%s' and `%s': Conflicting variables.\nTask index name `%s' not found in both system `%s' and global declaration.\nMake sure the names of indexing tasks match.",current_formula->func_field.definition.result_variable, variable_name, task_names[current_system][counter], system_names[current_system]);
+		    ceprintf("`%s' and `%s': Conflicting variables.\nTask index name `%s' not found in both system `%s' and global declaration.\nMake sure the names of indexing tasks match.",new_formula->func_field.definition.result_variable, variable_name, task_names[current_system][counter], system_names[current_system]);
 		    exit(-1);
 		  }
 	      }
 	    }
 
-	    else if (strcmp("j", operand) == 0) {
-	      dummy->func_field.op_field.var_field.index_type = J_INDEX;
-	      if ((check_global_variable(current_formula->func_field.definition.result_variable) && check_variable(variable_name, current_system)) ||
-		  (check_global_variable(variable_name) && check_variable(current_formula->func_field.definition.result_variable, current_system))) {
+	    else if ((strcmp("j", operand) == 0) || ((strcmp("k", operand) == 0) && (sigma_depth == 2))) {
+	      last_field->func_field.op_field.var_field.index_type = (operand[0] == 'j') ? J_INDEX : K_INDEX;
+	      if ((check_global_variable(new_formula->func_field.definition.result_variable) && check_variable(variable_name, current_system)) ||
+		  (check_global_variable(variable_name) && check_variable(new_formula->func_field.definition.result_variable, current_system))) {
 
 		/* This huge` if' checks if the result variable and the other variable
 		   used in the formula have a different set of indexing tasks. It should
 		   then check if these indexing tasks are the same. */
 
 		if (no_tasks[current_system] != no_global_tasks) {
-		    ceprintf("`%s' and `%s': Variables have different dimensions.\nMake sure the number of indexing tasks match.", current_formula->func_field.definition.result_variable, variable_name);
+		    ceprintf("`%s' and `%s': Variables have different dimensions.\nMake sure the number of indexing tasks match.", new_formula->func_field.definition.result_variable, variable_name);
 		    exit(-1);
 		}
 		else for (counter = 0; counter < no_tasks[current_system]; counter++)
 		  if (!check_global_task(task_names[current_system][counter])) {
-		    ceprintf("`%s' and `%s': Conflicting variables.\nTask index name `%s' not found in both system `%s' and global declaration.\nMake sure the names of indexing tasks match.",current_formula->func_field.definition.result_variable, variable_name, task_names[current_system][counter], system_names[current_system]);
+		    ceprintf("`%s' and `%s': Conflicting variables.\nTask index name `%s' not found in both system `%s' and global declaration.\nMake sure the names of indexing tasks match.",new_formula->func_field.definition.result_variable, variable_name, task_names[current_system][counter], system_names[current_system]);
 		    exit(-1);
 		  }
 	      }
 	    }
 
 	    else {
-	      dummy->func_field.op_field.var_field.index_type = SINGLE_INDEX;
-	      if (check_variable(dummy->func_field.op_field.var_field.variable_name, current_system)) {
+	      last_field->func_field.op_field.var_field.index_type = SINGLE_INDEX;
+	      if (check_variable(last_field->func_field.op_field.var_field.variable_name, current_system)) {
 		if (!check_task(operand, current_system)) {
 		  ceprintf("`%s' task not previously declared\n", operand);
 		  exit(-1);
 		}
 	      }
-	      else if (check_global_variable(dummy->func_field.op_field.var_field.variable_name)) {
+	      else if (check_global_variable(last_field->func_field.op_field.var_field.variable_name)) {
 		if (!check_global_task(operand)) {
 		  ceprintf("`%s' task not previously declared\n", operand);
 		  exit(-1);
 		}
 	      }
-	      strcpy(dummy->func_field.op_field.var_field.variable_index_task, operand);
+	      strcpy(last_field->func_field.op_field.var_field.variable_index_task, operand);
 	    }
 	  }
 	  break;
@@ -1246,6 +6989,54 @@ void declare_formula(char *operand, int action)
     }
 }
 
+/* Function declare_operation adds an operation, such as plus, minus
+   etc..., to the formula that is being declared. */
+
+void declare_operation(int operation)
+{
+  int current_system;
+
+  current_system = system_registry(GET_SYSTEM);
+  if (((operation == SIGMA_HP_OP) || (operation == SIGMA_LP_OP) || (operation == SIGMA_EP_OP)) &&
+      (priority_variable[current_system] == INVALID))
+    ceprintf("`sigma' Using prioritised summation without declaring a priority variable");
+
+  if (operation == END_SIGMA_OP)
+    sigma_depth--;
+  else if ((operation == SIGMA_HP_OP) || (operation == SIGMA_LP_OP) ||
+	   (operation == SIGMA_EP_OP) || (operation == SIGMA_ALL_OP))
+    if (++sigma_depth > 2) {
+      ceprintf("Summation nested in a nested summation\n");
+      exit(-1);
+    }
+
+  append_field(OP_FIELD);
+  last_field->func_field.op_field.operation = operation;
+}
+
+/* Function declare_constant adds a constant to the formula that is
+   being declared. */
+
+void declare_constant(double constant)
+{
+  append_field(CONST_FIELD);
+  last_field->func_field.op_field.constant = constant;
+}
+
+/* Function append_field adds a new field at the end of the formula
+   that is being declared. */
+
+void append_field(int field_type)
+{
+  last_field->next = calloc(1, sizeof(struct formula));
+  last_field = last_field->next;
+  if (last_field == NULL) {
+    fprintf(stderr, "Failed to allocate memory for formula.\n");
+    exit(-1);
+  }
+  last_field->field_type = field_type;
+}
+
 void output_variables(int no_systems)
 {
   int current_var, current_index, current_semaphore, current_system;
@@ -1256,7 +7047,9 @@ void output_variables(int no_systems)
     printf("------------------\n");
     for (current_var = 0;current_var < no_vars[current_system];current_var++) {
       printf("\nVariable `%s'\n", variable_names[current_system][current_var]);
-      if (variable_types[current_system][current_var] == INDEXED_VAR)
+      if (variable_types[current_system][current_var] == MATRIX_VAR)
+	output_matrix(current_system, current_var, 0, no_tasks[current_system] - 1);
+      else if (variable_types[current_system][current_var] == INDEXED_VAR)
 	for (current_index = 0;current_index < no_tasks[current_system];current_index++)
 	  printf("%s[%s] = %f\n", variable_names[current_system][current_var], task_names[current_system][current_index], variables[current_system][current_var][current_index]);
       else
@@ -1282,7 +7075,9 @@ void output_variables(int no_systems)
 void calculate_blocking(int current_system)
 {
   int current_task, current_semaphore, blocking_task;
-  double min_value, max_block;
+  double min_value, max_block, start;
+
+  start = tracing ? trace_clock() : 0.0;
 
   /* First, calculate the ceilings of all semaphores (assume that there
      is really a MAX_SEMAPHORES number of semaphores... */
@@ -1306,8 +7101,10 @@ void calculate_blocking(int current_system)
 	  if ((variables[current_system][priority_variable[current_system]][blocking_task] > variables[current_system][priority_variable[current_system]][current_task]) && (ceiling[current_system][current_semaphore] <= variables[current_system][priority_variable[current_system]][current_task]))
 	    if (semaphores[current_system][current_semaphore][blocking_task] > max_block)
 	      max_block = semaphores[current_system][current_semaphore][blocking_task];
-    variables[current_system][blocking_variable[current_system]][current_task] = max_block;
+    set_element(current_system, blocking_variable[current_system], current_task, max_block);
   }
+  if (tracing)
+    trace_span("blocking", "calculate_blocking", NULL, current_system, start, NO_COUNT, NAN);
 }
 
 /*
@@ -1327,8 +7124,8 @@ int check_dynamic_blocking(int current_system)
   for (current_formula = 0;current_formula < no_formulas[current_system];current_formula++)
     /* First, make sure the result variable is not a global, which makes it
        uneligible for a priority variable. */
-    if (check_variable(formulas[current_system][current_formula]->func_field.definition.result_variable, current_system))
-      if (get_variable_index(formulas[current_system][current_formula]->func_field.definition.result_variable, current_system) == priority_variable[current_system])
+    if (check_variable(result_name(formulas[current_system][current_formula], current_system), current_system))
+      if (get_variable_index(result_name(formulas[current_system][current_formula], current_system), current_system) == priority_variable[current_system])
 	dynamic_blocking = TRUE;
 
   return(dynamic_blocking);
@@ -1340,44 +7137,219 @@ int check_dynamic_blocking(int current_system)
    values are kept. Then, the system is run again until the next
    conversion. When stable priorities have been found, the system
    can be considered completely converged... This is a tricky little
-   algorithm, that's why I wrote this comment... */
+   algorithm, that's why I wrote this comment...
+
+   The priorities of every conversion in a round are remembered by
+   their hash. If an assignment comes back, the priorities oscillate
+   and would do so forever: the refreshing stops with a warning, and
+   the priorities are put back to the ones the results were calculated
+   with. The same happens after MAX_REFRESHES refreshes. */
 
 int priority_refresh(int current_system)
 {
   int var_counter,
   formula_counter,
   counter,
-  changed;
+  changed,
+  priority_var;
+  double old_priorities[MAX_TASKS];
+  hash_t hash;
 
   changed = FALSE;
+  priority_var = priority_variable[current_system];
 
   for (counter = 0; counter < no_tasks[current_system]; counter++)
-    if (variables[current_system][priority_variable[current_system]][counter] !=
-	backup_vars[current_system][priority_variable[current_system]][counter])
+    if (variables[current_system][priority_var][counter] !=
+	backup_vars[current_system][priority_var][counter])
       changed = TRUE;
-  if (changed) {
-    for (var_counter = 0; var_counter < no_vars[current_system]; var_counter++)
-      if (var_counter == priority_variable[current_system])
-	for (counter = 0; counter < no_tasks[current_system]; counter++)
-	  backup_vars[current_system][priority_variable[current_system]][counter] = variables[current_system][priority_variable[current_system]][counter];
-      else
-	for (counter = 0; counter < no_tasks[current_system]; counter++)
-	  variables[current_system][var_counter][counter] = backup_vars[current_system][var_counter][counter];
+  if (!changed)
+    return(FALSE);
+
+  if (no_refreshes[current_system] == 0)
+    refresh_history[current_system][no_refreshes[current_system]++] =
+      priority_hash(backup_vars[current_system][priority_var], no_tasks[current_system]);
+  hash = priority_hash(variables[current_system][priority_var], no_tasks[current_system]);
+  for (counter = 0; counter < no_refreshes[current_system]; counter++)
+    if (refresh_history[current_system][counter] == hash)
+      break;
+  if ((counter < no_refreshes[current_system]) || (no_refreshes[current_system] == MAX_REFRESHES)) {
+    if (counter < no_refreshes[current_system])
+      fprintf(stderr, "System `%s': the priorities oscillate with a period of %d refreshes, the results are for the last assignment analysed.\n",
+	      system_names[current_system], no_refreshes[current_system] - counter);
+    else
+      fprintf(stderr, "System `%s': the priorities haven't settled after %d refreshes, the results are for the last assignment analysed.\n",
+	      system_names[current_system], MAX_REFRESHES);
+    for (counter = 0; counter < no_tasks[current_system]; counter++)
+      set_element(current_system, priority_var, counter, backup_vars[current_system][priority_var][counter]);
+    return(FALSE);
+  }
+  refresh_history[current_system][no_refreshes[current_system]++] = hash;
 
-    /* Now check if a global variable is the result of one of the system
-       formulae. In such a case, this global variable has to be backed up
-       from the original values as well. */
+  for (counter = 0; counter < no_tasks[current_system]; counter++) {
+    old_priorities[counter] = backup_vars[current_system][priority_var][counter];
+    backup_vars[current_system][priority_var][counter] = variables[current_system][priority_var][counter];
+  }
 
-    for (formula_counter = 0; formula_counter < no_formulas[current_system]; formula_counter++) {
+  if (formula_writes(current_system, INVALID) || (blocking_variable[current_system] != INVALID) ||
+      (matrix_size[current_system] > 0) || !static_priorities(current_system))
+    reset_system(current_system);
+  else
+    refresh_reset(current_system, old_priorities);
 
-      if (check_global_variable(formulas[current_system][formula_counter]->func_field.definition.result_variable)) {
-	var_counter = get_global_variable_index(formulas[current_system][formula_counter]->func_field.definition.result_variable);
-	for (counter = 0; counter < no_global_tasks; counter++)
-	  global_variables[var_counter][counter] = global_backup_vars[var_counter][counter];
-      }
+  /* Now check if a global variable is the result of one of the system
+     formulae. In such a case, this global variable has to be backed up
+     from the original values as well. */
+
+  for (formula_counter = 0; formula_counter < no_formulas[current_system]; formula_counter++) {
+
+    if (check_global_variable(result_name(formulas[current_system][formula_counter], current_system))) {
+      var_counter = get_global_variable_index(result_name(formulas[current_system][formula_counter], current_system));
+      for (counter = 0; counter < no_global_tasks; counter++)
+	global_variables[var_counter][counter] = global_backup_vars[var_counter][counter];
+      touch_globals();
     }
   }
-  return(changed);
+  return(TRUE);
+}
+
+hash_t priority_hash(double *priorities, int size)
+{
+  hash_t hash;
+
+  hash = ((hash_t) 0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+  return(hash_bytes(hash, priorities, size * sizeof(double)));
+}
+
+/* STATIC_PRIORITIES
+
+   Tells whether the priorities of a system are computed only from
+   variables that no formula writes. Then they don't move during a
+   calculation, and its results don't depend on where it started.
+   Priorities computed from results may reach another assignment from
+   other starting values, so those systems are reset completely.
+*/
+
+int static_priorities(int current_system)
+{
+  struct formula_reads *formula_reads;
+  int current_formula, read;
+
+  for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+    if (!check_variable(result_name(formulas[current_system][current_formula], current_system), current_system) ||
+	(get_variable_index(result_name(formulas[current_system][current_formula], current_system), current_system) !=
+	 priority_variable[current_system]))
+      continue;
+    formula_reads = &reads[current_system][current_formula];
+    if (formula_reads->untracked)
+      return(FALSE);
+    for (read = 0; read < formula_reads->no_reads; read++)
+      if (formula_reads->global[read] || formula_writes(current_system, formula_reads->variable[read]))
+	return(FALSE);
+  }
+  return(TRUE);
+}
+
+/* REFRESH_RESET
+
+   Resets the elements of a system that a priority refresh can change,
+   instead of all of them: the results of the tasks whose place among
+   the other tasks has changed, the elements that read a priority that
+   has changed, and everything that reads those, following the reads of
+   the formulas forward until nothing new is found. Of the elements read
+   by `j', only those of the tasks in the summation count when all the
+   summations of the formula are over the same tasks, and the priorities
+   that collect_reads adds for the summations are left to 'moved'. The
+   converged values of the rest still hold under the new priorities and
+   are kept, so the next calculation starts from them. Systems with
+   global results, blocking factors or matrices, or whose priorities
+   aren't static, are reset completely by reset_system.
+*/
+
+void refresh_reset(int current_system, double *old_priorities)
+{
+  struct formula_reads *formula_reads;
+  formula_t position;
+  double *priorities;
+  int moved[MAX_TASKS];
+  int current_formula, var_counter, counter, other, read, type, result_var, first_task, last_task,
+  any_moved, change, reset, operation, priority_read;
+
+  priorities = variables[current_system][priority_variable[current_system]];
+  any_moved = FALSE;
+  for (counter = 0; counter < no_tasks[current_system]; counter++) {
+    moved[counter] = FALSE;
+    for (other = 0; other < no_tasks[current_system]; other++)
+      if (((priorities[other] < priorities[counter]) != (old_priorities[other] < old_priorities[counter])) ||
+	  ((priorities[other] > priorities[counter]) != (old_priorities[other] > old_priorities[counter])))
+	moved[counter] = any_moved = TRUE;
+  }
+
+  memset(stale[current_system], 0, sizeof(stale[0]));
+  for (counter = 0; counter < no_tasks[current_system]; counter++)
+    stale[current_system][priority_variable[current_system]][counter] = (priorities[counter] != old_priorities[counter]);
+
+  do {
+    change = FALSE;
+    for (current_formula = 0; current_formula < no_formulas[current_system]; current_formula++) {
+      result_var = get_variable_index(result_name(formulas[current_system][current_formula], current_system), current_system);
+      type = formulas[current_system][current_formula]->func_field.definition.index_type;
+      if (type == SINGLE_INDEX)
+	first_task = last_task = get_task_index(result_task(formulas[current_system][current_formula], current_system), current_system);
+      else if (type == I_INDEX) {
+	first_task = 0;
+	last_task = no_tasks[current_system] - 1;
+      }
+      else
+	first_task = last_task = 0;
+      formula_reads = &reads[current_system][current_formula];
+      operation = INVALID;
+      priority_read = FALSE;
+      for (position = formulas[current_system][current_formula]; position != NULL; position = position->next)
+	if ((position->field_type == VAR_FIELD) && (position->func_field.op_field.var_field.index_type == J_INDEX) &&
+	    (strcmp(field_name(position, current_system),
+		    variable_names[current_system][priority_variable[current_system]]) == 0))
+	  priority_read = TRUE;
+	else if ((position->field_type == OP_FIELD) &&
+	    ((position->func_field.op_field.operation == SIGMA_HP_OP) || (position->func_field.op_field.operation == SIGMA_LP_OP) ||
+	     (position->func_field.op_field.operation == SIGMA_EP_OP) || (position->func_field.op_field.operation == SIGMA_ALL_OP)))
+	  operation = ((operation == INVALID) || (operation == position->func_field.op_field.operation)) ?
+	    position->func_field.op_field.operation : SIGMA_ALL_OP;
+      if (operation == INVALID)
+	operation = SIGMA_ALL_OP;
+
+      for (counter = first_task; counter <= last_task; counter++) {
+	if (stale[current_system][result_var][counter])
+	  continue;
+	reset = formula_reads->untracked || ((type == SCALAR) ? any_moved : moved[counter]);
+	for (read = 0; (read < formula_reads->no_reads) && !reset; read++)
+	  if (formula_reads->global[read] ||
+	      ((formula_reads->variable[read] == priority_variable[current_system]) &&
+	       (formula_reads->index_type[read] == J_INDEX) && !priority_read))
+	    continue;
+	  else if (formula_reads->index_type[read] == SINGLE_INDEX)
+	    reset = stale[current_system][formula_reads->variable[read]][formula_reads->task[read]];
+	  else if ((formula_reads->index_type[read] == I_INDEX) && (type != SCALAR))
+	    reset = stale[current_system][formula_reads->variable[read]][counter];
+	  else if ((formula_reads->index_type[read] == J_INDEX) && (type != SCALAR))
+	    for (other = 0; (other < no_tasks[current_system]) && !reset; other++)
+	      reset = stale[current_system][formula_reads->variable[read]][other] && sigma_member(operation, other, counter, current_system);
+	  else
+	    for (other = 0; (other < no_tasks[current_system]) && !reset; other++)
+	      reset = stale[current_system][formula_reads->variable[read]][other];
+	if (reset) {
+	  stale[current_system][result_var][counter] = TRUE;
+	  change = TRUE;
+	}
+      }
+    }
+  } while (change);
+
+  for (var_counter = 0; var_counter < no_vars[current_system]; var_counter++)
+    if (var_counter != priority_variable[current_system])
+      for (counter = 0; counter < no_tasks[current_system]; counter++)
+	if (stale[current_system][var_counter][counter])
+	  variables[current_system][var_counter][counter] = backup_vars[current_system][var_counter][counter];
+  touch_system(current_system);
 }
 
 int get_variable_index(char *var, int current_system)
@@ -1545,6 +7517,8 @@ double min(double x,
 void push(double data,
 	  int current_system)
 {
+  if (stack_slot != INVALID)
+    current_system = stack_slot;
   if (stack_pointer[current_system] >= STACK_SIZE - 1) {
     fprintf(stderr, "Stack overflow in system no. %d!\n", current_system + 1);
     exit(-1);
@@ -1557,6 +7531,8 @@ double pop(int current_system)
 {
   double data;
 
+  if (stack_slot != INVALID)
+    current_system = stack_slot;
   if (stack_pointer[current_system] == 0) {
     fprintf(stderr, "Stack underflow in system no. %d!\n", current_system + 1);
     exit(-1);
@@ -5,20 +5,25 @@
 typedef enum { FORM_CREATE };
 */
 
-typedef enum { INDEXED_VAR, SCALAR_VAR, BLOCKING_VAR, PRIORITY_VAR } var_t;
-typedef enum { NEW_FORMULA, FORMULA_END, FORMULA_INDEX, FORMULA_OP, FORMULA_CONST, FORMULA_VAR } form_dec_t;
-typedef enum { GET_SYSTEM, NEXT_SYSTEM } sys_req_t;
+typedef enum { INDEXED_VAR, SCALAR_VAR, BLOCKING_VAR, PRIORITY_VAR, DEADLINE_VAR, MATRIX_VAR } var_t;
+typedef enum { NEW_FORMULA, FORMULA_END, FORMULA_INDEX, FORMULA_VAR, FORMULA_COLUMN } form_dec_t;
+typedef enum { INIT_ELEMENT, INIT_COLUMN } init_dec_t;
+typedef enum { PLUS_OP, MINUS_OP, MULTIPLY_OP, DIVIDE_OP, UMINUS_OP, MIN_OP, MAX_OP, FLOOR_OP, CEILING_OP, SIGMA_HP_OP, SIGMA_LP_OP, SIGMA_ALL_OP, SIGMA_EP_OP, END_SIGMA_OP } op_t;
+typedef enum { GET_SYSTEM, NEXT_SYSTEM, RESET_SYSTEMS } sys_req_t;
 
 /* Prototypes */
 
-void declare_system(char *);
+void declare_system(char *, char *);
 void declare_variable(char *, int);
 void add_semaphore(char *, char *, double);
 void declare_task(char *);
 void declare_global_task(char *);
 void declare_formula(char *, int);
+void declare_operation(int);
+void declare_constant(double);
 void declare_global_variable(char *, int);
 int system_registry(int);
 void init_variable(char *, char *, double);
+void init_column(char *);
 
 #endif
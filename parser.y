@@ -1,24 +1,36 @@
 %{
-#include "LUF.h"
 #include "fpsmain.h"
+#include "build.h"
 #include <string.h>
 #include <stdlib.h>
 
-int yylex(void);
+/* The parser is pure, and the scanner reentrant: all the state of a
+   parse is in the scanner and in the build context, which receives the
+   declarations. */
 
 %}
 
+%define api.pure full
+%lex-param { void *scanner }
+%parse-param { void *scanner } { struct build_context *context }
+
 %union {
   int integer;
   char *string;
   double floating;
 }
 
-%token <string> NUMBER ID
+%{
+int yylex(YYSTYPE *, void *);
+static void yyerror(void *, struct build_context *, const char *);
+%}
+
+%token <floating> NUMBER
+%token <string> ID
 %token DECLARATION LEFTPAREN RIGHTPAREN LEFTHOOK RIGHTHOOK SYS
 %token COMMA SEMICOLON STAR SLASH PLUS MINUS ASSIGN INITIALISE
-%token VAR BLOCKING PRIORITY CEILING FLOOR SIGMA HP LP EP ALL
-%token MIN MAX TASKS SEMAPHORE INDEXVAR N_INDEXVAR SCALAR INDEXED
+%token VAR BLOCKING PRIORITY DEADLINE CEILING FLOOR SIGMA HP LP EP ALL
+%token MIN MAX TASKS SEMAPHORE INDEXVAR N_INDEXVAR SCALAR INDEXED MATRIX EXTENDS
 %token LEFTBRACE RIGHTBRACE FORMULAS DECLARATIONS SEMAPHORES
 
 %left PLUS MINUS
@@ -28,13 +40,11 @@ int yylex(void);
 %right UMINUS
 
 %type <floating> NumberExpression
+%type <string> Column
 
 %%
 
 TaskSet	: GloabalDecs Systems
-	  {
-	    return(system_registry(GET_SYSTEM) + 1);
-	  }
 	;
 
 GloabalDecs
@@ -51,33 +61,33 @@ GloabalDec
 GlobalIndexVarList
 	:  GlobalIndexVarList COMMA ID
 	    {
-	      declare_global_variable($3, INDEXED_VAR);
+	      record(context, GLOBAL_VARIABLE_DEC, $3, NULL, 0.0, INDEXED_VAR);
 	    }
 	| ID
 	    {
-	      declare_global_variable($1, INDEXED_VAR);
+	      record(context, GLOBAL_VARIABLE_DEC, $1, NULL, 0.0, INDEXED_VAR);
 	    }
 	;
 
 GlobalScalarVarList
 	: ID COMMA GlobalScalarVarList
 	    {
-	      declare_global_variable($1, SCALAR_VAR);
+	      record(context, GLOBAL_VARIABLE_DEC, $1, NULL, 0.0, SCALAR_VAR);
 	    }
 	| ID
 	    {
-	      declare_global_variable($1, SCALAR_VAR);
+	      record(context, GLOBAL_VARIABLE_DEC, $1, NULL, 0.0, SCALAR_VAR);
 	    }
 	;
 
 GlobalNameList
 	: GlobalNameList COMMA ID
 	    {
-	      declare_global_task($3);
+	      record(context, GLOBAL_TASK_DEC, $3, NULL, 0.0, 0);
 	    }
 	| ID
 	    {
-	      declare_global_task($1);
+	      record(context, GLOBAL_TASK_DEC, $1, NULL, 0.0, 0);
 	    }
 	;
 
@@ -88,29 +98,55 @@ Systems	: Systems SystemDef
 SystemDef
 	: SYS ID LEFTBRACE
 	    {
-	      declare_system($2);
+	      record(context, SYSTEM_DEC, $2, NULL, 0.0, 0);
 	    }
 	  DeclareBlock SemBlock Initialisation FormulaBlock RIGHTBRACE
+	| SYS ID EXTENDS ID LEFTBRACE
+	    {
+	      record(context, SYSTEM_DEC, $2, $4, 0.0, 0);
+	    }
+	  VariantDeclareBlock SemBlock Initialisation VariantFormulaBlock RIGHTBRACE
+	;
+
+/* A variant starts as a copy of the system it extends, and only
+   declares what it adds or overrides */
+
+VariantDeclareBlock
+	: DeclareBlock
+	| /* empty */
+	;
+
+VariantFormulaBlock
+	: FormulaBlock
+	| /* empty */
 	;
 
 DeclareBlock
 	: DECLARATIONS LEFTBRACE Declarations RIGHTBRACE
 
+/* Long lists are left recursive, so that the parser stack doesn't grow
+   with the length of the input */
+
 Declarations
-	: Declaration Declarations
+	: Declarations Declaration
 	| /* empty */
 	;
 
 Declaration
 	: INDEXED IndexVarList SEMICOLON
 	| SCALAR ScalarVarList SEMICOLON
+	| MATRIX MatrixVarList SEMICOLON
 	| BLOCKING ID SEMICOLON
 	    {
-	      declare_variable($2, BLOCKING_VAR);
+	      record(context, VARIABLE_DEC, $2, NULL, 0.0, BLOCKING_VAR);
 	    }
 	| PRIORITY ID SEMICOLON
 	    {
-	      declare_variable($2, PRIORITY_VAR);
+	      record(context, VARIABLE_DEC, $2, NULL, 0.0, PRIORITY_VAR);
+	    }
+	| DEADLINE ID SEMICOLON
+	    {
+	      record(context, VARIABLE_DEC, $2, NULL, 0.0, DEADLINE_VAR);
 	    }
 	| TASKS NameList SEMICOLON
 	;
@@ -120,14 +156,14 @@ SemBlock
 	| /* empty */
 
 Semaphores
-	: Semaphore Semaphores
+	: Semaphores Semaphore
 	| /* empty */
 	;
 
 Semaphore
 	: SEMAPHORE LEFTPAREN ID COMMA ID COMMA NUMBER RIGHTPAREN SEMICOLON
 	    {
-	      add_semaphore($3, $5, strtod($7, NULL));
+	      record(context, SEMAPHORE_DEC, $3, $5, $7, 0);
 	    }
 	;
 
@@ -135,33 +171,44 @@ Semaphore
 IndexVarList
 	:  IndexVarList COMMA ID
 	    {
-	      declare_variable($3, INDEXED_VAR);
+	      record(context, VARIABLE_DEC, $3, NULL, 0.0, INDEXED_VAR);
 	    }
 	| ID
 	    {
-	      declare_variable($1, INDEXED_VAR);
+	      record(context, VARIABLE_DEC, $1, NULL, 0.0, INDEXED_VAR);
 	    }
 	;
 
 ScalarVarList
 	: ID COMMA ScalarVarList
 	    {
-	      declare_variable($1, SCALAR_VAR);
+	      record(context, VARIABLE_DEC, $1, NULL, 0.0, SCALAR_VAR);
 	    }
 	| ID
 	    {
-	      declare_variable($1, SCALAR_VAR);
+	      record(context, VARIABLE_DEC, $1, NULL, 0.0, SCALAR_VAR);
+	    }
+	;
+
+MatrixVarList
+	: MatrixVarList COMMA ID
+	    {
+	      record(context, VARIABLE_DEC, $3, NULL, 0.0, MATRIX_VAR);
+	    }
+	| ID
+	    {
+	      record(context, VARIABLE_DEC, $1, NULL, 0.0, MATRIX_VAR);
 	    }
 	;
 
 NameList
 	: NameList COMMA ID
 	    {
-	      declare_task($3);
+	      record(context, TASK_DEC, $3, NULL, 0.0, 0);
 	    }
 	| ID
 	    {
-	      declare_task($1);
+	      record(context, TASK_DEC, $1, NULL, 0.0, 0);
 	    }
 	;
 
@@ -170,23 +217,49 @@ Initialisation
 	| /* empty */
 	;
 
-Inits	: Init Inits
+Inits	: Inits Init
 	| /* empty */
 	;
 
 Init	: ID LEFTHOOK ID RIGHTHOOK ASSIGN NumberExpression SEMICOLON
 	  {
-	    init_variable($1, $3, $6);
+	    record(context, INIT_DEC, $1, $3, $6, 0);
 	  }
 	| ID LEFTHOOK INDEXVAR RIGHTHOOK ASSIGN NumberExpression SEMICOLON
 	  {
-	    init_variable($1, "i", $6);
+	    record(context, INIT_DEC, $1, "i", $6, 0);
+	  }
+	| ID LEFTHOOK ID RIGHTHOOK Column ASSIGN NumberExpression SEMICOLON
+	  {
+	    record(context, INIT_DEC, $1, $5, 0.0, INIT_COLUMN);
+	    record(context, INIT_DEC, $1, $3, $7, 0);
+	  }
+	| ID LEFTHOOK INDEXVAR RIGHTHOOK Column ASSIGN NumberExpression SEMICOLON
+	  {
+	    record(context, INIT_DEC, $1, $5, 0.0, INIT_COLUMN);
+	    record(context, INIT_DEC, $1, "i", $7, 0);
 	  }
 	| ID ASSIGN NumberExpression SEMICOLON
 	  {
-	    init_variable($1, NULL, $3);
+	    record(context, INIT_DEC, $1, NULL, $3, 0);
 	  }
 
+/* The second index of a matrix element */
+
+Column	: LEFTHOOK ID RIGHTHOOK
+	  {
+	    $$ = $2;
+	  }
+	| LEFTHOOK INDEXVAR RIGHTHOOK
+	  {
+	    $$ = "i";
+	  }
+	| LEFTHOOK N_INDEXVAR RIGHTHOOK
+	  {
+	    $$ = "j";
+	  }
+	;
+
 NumberExpression
 	: NumberExpression PLUS NumberExpression
 	  {
@@ -214,7 +287,7 @@ NumberExpression
 	  }
 	| NUMBER
 	  {
-	    $$ = strtod($1, NULL);
+	    $$ = $1;
 	  }
 	;
 
@@ -223,266 +296,364 @@ FormulaBlock
 	;
 
 Formulas
-	: Formula Formulas
+	: Formulas Formula
 	| /* empty */
 	;
 
 Formula	: ID LEFTHOOK ID RIGHTHOOK ASSIGN
 	  {
-	    declare_formula($1, NEW_FORMULA);
-	    declare_formula($3, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, NEW_FORMULA);
+	    record(context, FORMULA_DEC, $3, NULL, 0.0, FORMULA_INDEX);
 	  }
 	  SimpleExpression SEMICOLON
 	  {
-	    declare_formula(NULL, FORMULA_END);
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_END);
 	  }
 	| ID LEFTHOOK INDEXVAR RIGHTHOOK ASSIGN
 	  {
-	    declare_formula($1, NEW_FORMULA);
-	    declare_formula("i", FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, NEW_FORMULA);
+	    record(context, FORMULA_DEC, "i", NULL, 0.0, FORMULA_INDEX);
 	  }
 	  Expression SEMICOLON
 	  {
-	    declare_formula(NULL, FORMULA_END);
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_END);
+	  }
+	| ID LEFTHOOK INDEXVAR RIGHTHOOK LEFTHOOK N_INDEXVAR RIGHTHOOK ASSIGN
+	  {
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, NEW_FORMULA);
+	    record(context, FORMULA_DEC, "j", NULL, 0.0, FORMULA_COLUMN);
+	    record(context, FORMULA_DEC, "i", NULL, 0.0, FORMULA_INDEX);
+	  }
+	  SummationExpression SEMICOLON
+	  {
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_END);
 	  }
 	| ID LEFTHOOK N_INDEXVAR RIGHTHOOK ASSIGN
 	  {
-	    ceprintf("Secondary index (`j') used outside a summation\n");
+	    build_error(context, "Secondary index (`j') used outside a summation\n");
 	  }
 	| ID ASSIGN
 	  {
-	    declare_formula($1, NEW_FORMULA);
-	    declare_formula(NULL, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, NEW_FORMULA);
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_INDEX);
 	  }
 	  SimpleExpression SEMICOLON
 	  {
-	    declare_formula(NULL, FORMULA_END);
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_END);
 	  }
 
 Expression
 	: Expression PLUS Expression
 	  {
-	    declare_formula("PLUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, PLUS_OP);
 	  }
 	| Expression MINUS Expression
 	  {
-	    declare_formula("MINUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MINUS_OP);
 	  }
 	| Expression STAR Expression
 	  {
-	    declare_formula("MULTIPLY", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MULTIPLY_OP);
 	  }
 	| Expression SLASH Expression
 	  {
-	    declare_formula("DIVIDE", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, DIVIDE_OP);
 	  }
 	| MINUS Expression %prec UMINUS
 	  {
-	    declare_formula("UMINUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, UMINUS_OP);
 	  }
 	| FLOOR LEFTPAREN Expression RIGHTPAREN
 	  {
-	    declare_formula("FLOOR", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, FLOOR_OP);
 	  }
 	| CEILING LEFTPAREN Expression RIGHTPAREN
 	  {
-	    declare_formula("CEILING", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, CEILING_OP);
 	  }
 	| SIGMA LEFTPAREN HP
 	  {
-	    declare_formula("SIGMA_HP", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_HP_OP);
 	  }
 	  COMMA SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("END_SIGMA", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
 	  }
 	| SIGMA LEFTPAREN LP
 	  {
-	    declare_formula("SIGMA_LP", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_LP_OP);
 	  }
 	  COMMA SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("END_SIGMA", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
 	  }
 	| SIGMA LEFTPAREN ALL
 	  {
-	    declare_formula("SIGMA_ALL", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_ALL_OP);
 	  }
 	  COMMA SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("END_SIGMA", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
 	  }
 	| SIGMA LEFTPAREN EP
 	  {
-	    declare_formula("SIGMA_EP", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_EP_OP);
 	  }
 	  COMMA SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("END_SIGMA", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
 	  }
 	| MAX LEFTPAREN Expression COMMA Expression RIGHTPAREN
 	  {
-	    declare_formula("MAX", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MAX_OP);
 	  }
 	| MIN LEFTPAREN Expression COMMA Expression RIGHTPAREN
 	  {
-	    declare_formula("MIN", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MIN_OP);
 	  }
 	| LEFTPAREN Expression RIGHTPAREN {}
 	| NUMBER
 	  {
-	    declare_formula($1, FORMULA_CONST);
+	    record(context, CONSTANT_DEC, NULL, NULL, $1, 0);
 	  }
 	| ID
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula(NULL, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_INDEX);
 	  }
 	| ID LEFTHOOK ID RIGHTHOOK
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula($3, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $3, NULL, 0.0, FORMULA_INDEX);
 	  }
 	| ID LEFTHOOK INDEXVAR RIGHTHOOK
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula("i", FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, "i", NULL, 0.0, FORMULA_INDEX);
 	  }
 	| ID LEFTHOOK N_INDEXVAR RIGHTHOOK
 	  {
-	    ceprintf("Secondary index (`j') used outside a summation\n");
+	    build_error(context, "Secondary index (`j') used outside a summation\n");
+	  }
+	| ID LEFTHOOK ID RIGHTHOOK Column
+	  {
+	    if (strcmp($5, "j") == 0)
+	      build_error(context, "Secondary index (`j') used outside a summation\n");
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $5, NULL, 0.0, FORMULA_COLUMN);
+	    record(context, FORMULA_DEC, $3, NULL, 0.0, FORMULA_INDEX);
+	  }
+	| ID LEFTHOOK INDEXVAR RIGHTHOOK Column
+	  {
+	    if (strcmp($5, "j") == 0)
+	      build_error(context, "Secondary index (`j') used outside a summation\n");
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $5, NULL, 0.0, FORMULA_COLUMN);
+	    record(context, FORMULA_DEC, "i", NULL, 0.0, FORMULA_INDEX);
+	  }
+	| ID LEFTHOOK N_INDEXVAR RIGHTHOOK Column
+	  {
+	    build_error(context, "Secondary index (`j') used outside a summation\n");
 	  }
 	;
 
 SummationExpression
 	: SummationExpression PLUS SummationExpression
 	  {
-	    declare_formula("PLUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, PLUS_OP);
 	  }
 
 	| SummationExpression MINUS SummationExpression
 	  {
-	    declare_formula("MINUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MINUS_OP);
 	  }
 	| SummationExpression STAR SummationExpression
 	  {
-	    declare_formula("MULTIPLY", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MULTIPLY_OP);
 	  }
 	| SummationExpression SLASH SummationExpression
 	  {
-	    declare_formula("DIVIDE", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, DIVIDE_OP);
 	  }
 	| MINUS SummationExpression %prec UMINUS
 	  {
-	    declare_formula("UMINUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, UMINUS_OP);
 	  }
 	| FLOOR LEFTPAREN SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("FLOOR", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, FLOOR_OP);
 	  }
 	| CEILING LEFTPAREN SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("CEILING", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, CEILING_OP);
+	  }
+	| SIGMA LEFTPAREN HP
+	  {
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_HP_OP);
+	  }
+	  COMMA SummationExpression RIGHTPAREN
+	  {
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
+	  }
+	| SIGMA LEFTPAREN LP
+	  {
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_LP_OP);
 	  }
-	| SIGMA
+	  COMMA SummationExpression RIGHTPAREN
+	  {
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
+	  }
+	| SIGMA LEFTPAREN ALL
+	  {
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_ALL_OP);
+	  }
+	  COMMA SummationExpression RIGHTPAREN
 	  {
-	    ceprintf("Nested summation\n");
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
+	  }
+	| SIGMA LEFTPAREN EP
+	  {
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, SIGMA_EP_OP);
+	  }
+	  COMMA SummationExpression RIGHTPAREN
+	  {
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, END_SIGMA_OP);
 	  }
 	| MAX LEFTPAREN SummationExpression COMMA SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("MAX", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MAX_OP);
 	  }
 	| MIN LEFTPAREN SummationExpression COMMA SummationExpression RIGHTPAREN
 	  {
-	    declare_formula("MIN", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MIN_OP);
 	  }
 	| LEFTPAREN SummationExpression RIGHTPAREN {}
 	| NUMBER
 	  {
-	    declare_formula($1, FORMULA_CONST);
+	    record(context, CONSTANT_DEC, NULL, NULL, $1, 0);
 	  }
 	| ID
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula(NULL, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_INDEX);
 	  }
 	| ID LEFTHOOK ID RIGHTHOOK
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula($3, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $3, NULL, 0.0, FORMULA_INDEX);
 	  }
 	| ID LEFTHOOK INDEXVAR RIGHTHOOK
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula("i", FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, "i", NULL, 0.0, FORMULA_INDEX);
 	  }
 	| ID LEFTHOOK N_INDEXVAR RIGHTHOOK
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula("j", FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, "j", NULL, 0.0, FORMULA_INDEX);
+	  }
+	| ID LEFTHOOK ID RIGHTHOOK Column
+	  {
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $5, NULL, 0.0, FORMULA_COLUMN);
+	    record(context, FORMULA_DEC, $3, NULL, 0.0, FORMULA_INDEX);
+	  }
+	| ID LEFTHOOK INDEXVAR RIGHTHOOK Column
+	  {
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $5, NULL, 0.0, FORMULA_COLUMN);
+	    record(context, FORMULA_DEC, "i", NULL, 0.0, FORMULA_INDEX);
+	  }
+	| ID LEFTHOOK N_INDEXVAR RIGHTHOOK Column
+	  {
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $5, NULL, 0.0, FORMULA_COLUMN);
+	    record(context, FORMULA_DEC, "j", NULL, 0.0, FORMULA_INDEX);
 	  }
 	;
 
 SimpleExpression
 	: SimpleExpression PLUS SimpleExpression
 	  {
-	    declare_formula("PLUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, PLUS_OP);
 	  }
 
 	| SimpleExpression MINUS SimpleExpression
 	  {
-	    declare_formula("MINUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MINUS_OP);
 	  }
 	| SimpleExpression STAR SimpleExpression
 	  {
-	    declare_formula("MULTIPLY", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MULTIPLY_OP);
 	  }
 	| SimpleExpression SLASH SimpleExpression
 	  {
-	    declare_formula("DIVIDE", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, DIVIDE_OP);
 	  }
 	| MINUS SimpleExpression %prec UMINUS
 	  {
-	    declare_formula("UMINUS", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, UMINUS_OP);
 	  }
 	| FLOOR LEFTPAREN SimpleExpression RIGHTPAREN
 	  {
-	    declare_formula("FLOOR", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, FLOOR_OP);
 	  }
 	| CEILING LEFTPAREN SimpleExpression RIGHTPAREN
 	  {
-	    declare_formula("CEILING", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, CEILING_OP);
 	  }
 	| MAX LEFTPAREN SimpleExpression COMMA SimpleExpression RIGHTPAREN
 	  {
-	    declare_formula("MAX", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MAX_OP);
 	  }
 	| MIN LEFTPAREN SimpleExpression COMMA SimpleExpression RIGHTPAREN
 	  {
-	    declare_formula("MIN", FORMULA_OP);
+	    record(context, OPERATION_DEC, NULL, NULL, 0.0, MIN_OP);
 	  }
 	| LEFTPAREN SimpleExpression RIGHTPAREN {}
 	| NUMBER
 	  {
-	    declare_formula($1, FORMULA_CONST);
+	    record(context, CONSTANT_DEC, NULL, NULL, $1, 0);
 	  }
 	| ID LEFTHOOK INDEXVAR RIGHTHOOK
 	  {
-	    ceprintf("Index used in formula with non-indexed result\n");
+	    build_error(context, "Index used in formula with non-indexed result\n");
 	  }
 	| ID LEFTHOOK N_INDEXVAR RIGHTHOOK
 	  {
-	    ceprintf("Index used in formula with non-indexed result\n");
+	    build_error(context, "Index used in formula with non-indexed result\n");
 	  }
 	| ID LEFTHOOK ID RIGHTHOOK
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula($3, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $3, NULL, 0.0, FORMULA_INDEX);
+	  }
+	| ID LEFTHOOK ID RIGHTHOOK Column
+	  {
+	    if ((strcmp($5, "i") == 0) || (strcmp($5, "j") == 0))
+	      build_error(context, "Index used in formula with non-indexed result\n");
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, $5, NULL, 0.0, FORMULA_COLUMN);
+	    record(context, FORMULA_DEC, $3, NULL, 0.0, FORMULA_INDEX);
+	  }
+	| ID LEFTHOOK INDEXVAR RIGHTHOOK Column
+	  {
+	    build_error(context, "Index used in formula with non-indexed result\n");
+	  }
+	| ID LEFTHOOK N_INDEXVAR RIGHTHOOK Column
+	  {
+	    build_error(context, "Index used in formula with non-indexed result\n");
 	  }
 	| ID
 	  {
-	    declare_formula($1, FORMULA_VAR);
-	    declare_formula(NULL, FORMULA_INDEX);
+	    record(context, FORMULA_DEC, $1, NULL, 0.0, FORMULA_VAR);
+	    record(context, FORMULA_DEC, NULL, NULL, 0.0, FORMULA_INDEX);
 	  }
 	;
 
+%%
+
+static void yyerror(void *scanner, struct build_context *context, const char *message)
+{
+  build_error(context, "%s", message);
+}
@@ -0,0 +1,86 @@
+/* CLIENT
+
+   A client for fpscalc --serve on a Unix domain socket, used by the
+   tests. Sends the requests read from standard input, one per line,
+   and prints the replies. With -n count, the requests are sent count
+   times, only the replies of the last time are printed, and the
+   number of requests per second is written to standard error.
+
+     client [-n count] socket < requests
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define MAX_REQUESTS 1000
+#define LINE_SIZE 4096
+
+double now(void);
+
+int main(int argc, char **argv)
+{
+  struct sockaddr_un address;
+  FILE *input, *output;
+  char *requests[MAX_REQUESTS], line[LINE_SIZE];
+  int descriptor, no_requests, count, round, request;
+  double started, seconds;
+
+  count = 1;
+  if ((argc == 4) && (strcmp(argv[1], "-n") == 0))
+    count = atoi(argv[2]);
+  if (((argc != 2) && (argc != 4)) || (count < 1) || (strlen(argv[argc - 1]) >= sizeof(address.sun_path))) {
+    fprintf(stderr, "Usage: client [-n count] socket < requests\n");
+    exit(-1);
+  }
+
+  no_requests = 0;
+  while ((no_requests < MAX_REQUESTS) && (fgets(line, LINE_SIZE, stdin) != NULL))
+    if (strspn(line, " \t\r\n") != strlen(line))
+      requests[no_requests++] = strdup(line);
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, argv[argc - 1]);
+  descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((descriptor < 0) || (connect(descriptor, (struct sockaddr *) &address, sizeof(address)) != 0)) {
+    fprintf(stderr, "Can't connect to `%s'.\n", argv[argc - 1]);
+    exit(-1);
+  }
+  input = fdopen(descriptor, "r");
+  output = fdopen(dup(descriptor), "w");
+
+  started = now();
+  for (round = 0; round < count; round++)
+    for (request = 0; request < no_requests; request++) {
+      fputs(requests[request], output);
+      fflush(output);
+      if (fgets(line, LINE_SIZE, input) == NULL) {
+	fprintf(stderr, "The server closed the connection.\n");
+	exit(-1);
+      }
+      if (round == count - 1)
+	fputs(line, stdout);
+    }
+  seconds = now() - started;
+  if (count > 1)
+    fprintf(stderr, "%d requests in %.3f s (%.0f per second)\n",
+	    count * no_requests, seconds, (seconds > 0) ? count * no_requests / seconds : 0.0);
+  fclose(output);
+  fclose(input);
+  return(0);
+}
+
+/* Returns the time in seconds */
+
+double now(void)
+{
+  struct timeval time;
+
+  gettimeofday(&time, NULL);
+  return(time.tv_sec + time.tv_usec / 1e6);
+}
@@ -0,0 +1,157 @@
+#!/bin/sh
+#
+# Runs the models in this directory through fpscalc and compares what
+# it prints with NAME.out, from the source and compiled with --compile
+# and --load. If there is a NAME.max, it is the largest number of
+# iterations the analysis may take, counted in a --trace.
+#
+# The requests in NAME.serve are sent to fpscalc --serve, on standard
+# input and through a socket with the client, and the replies are
+# compared with NAME.replies, without the times. The requests per
+# second of the server are measured at the end.
+#
+# Options for fpscalc, if any, are in NAME.options. A model with a
+# NAME.threads is also run with each number of -j threads given there,
+# and has to print the same. Models called big_* have more tasks than
+# fpscalc is built for, and are run by fpscalc-big (see the Makefile).
+# Every run has to end within $TIMEOUT seconds.
+#
+#   sh tests/run.sh [fpscalc [client [fpscalc-big]]]
+
+FPSCALC=${1:-`dirname $0`/../fpscalc}
+CLIENT=${2:-`dirname $0`/client}
+BIG=${3:-`dirname $0`/fpscalc-big}
+case $FPSCALC in
+  /*) ;;
+  *) FPSCALC=`pwd`/$FPSCALC ;;
+esac
+case $CLIENT in
+  /*) ;;
+  *) CLIENT=`pwd`/$CLIENT ;;
+esac
+case $BIG in
+  /*) ;;
+  *) BIG=`pwd`/$BIG ;;
+esac
+cd `dirname $0`
+TIMEOUT=${TIMEOUT:-10}
+SOCKET=/tmp/fpscalc-test.$$
+TIMES='s/"seconds":[-+.0-9e]*/"seconds":0/g; s/"requests_per_second":[-+.0-9e]*/"requests_per_second":0/g'
+failed=0
+
+options() {
+  if [ -f $1.options ]; then
+    cat $1.options
+  fi
+}
+
+# Starts a server on $SOCKET and waits until it listens
+
+start_server() {
+  rm -f $SOCKET
+  $FPSCALC "$@" --serve $SOCKET 2> /dev/null &
+  server=$!
+  tries=0
+  while [ ! -S $SOCKET ] && [ $tries -lt 50 ]; do
+    sleep 0.1
+    tries=`expr $tries + 1`
+  done
+}
+
+stop_server() {
+  kill $server
+  wait $server 2> /dev/null
+  rm -f $SOCKET
+}
+
+for model in *.fps; do
+  name=`basename $model .fps`
+  fpscalc=$FPSCALC
+  case $name in
+    big_*) fpscalc=$BIG ;;
+  esac
+  if [ ! -x $fpscalc ]; then
+    echo "$name: skipped, there is no $fpscalc"
+    continue
+  fi
+  if ! timeout $TIMEOUT $fpscalc `options $name` --trace $name.trace < $model > $name.result 2> /dev/null; then
+    echo "$name: failed or didn't end"
+    failed=1
+  elif ! cmp -s $name.out $name.result; then
+    echo "$name: wrong results"
+    diff $name.out $name.result
+    failed=1
+  elif [ -f $name.max ] && [ `grep -c '"cat":"iteration"' $name.trace` -gt `cat $name.max` ]; then
+    echo "$name: more than `cat $name.max` iterations"
+    failed=1
+  else
+    echo "$name: ok"
+  fi
+
+  # The same model compiled with --compile and run with --load
+
+  if ! timeout $TIMEOUT $fpscalc --compile $name.model < $model 2> /dev/null ||
+     ! timeout $TIMEOUT $fpscalc `options $name` --load $name.model > $name.result 2> /dev/null; then
+    echo "$name (compiled): failed or didn't end"
+    failed=1
+  elif ! cmp -s $name.out $name.result; then
+    echo "$name (compiled): wrong results"
+    diff $name.out $name.result
+    failed=1
+  else
+    echo "$name (compiled): ok"
+  fi
+
+  if [ -f $name.threads ]; then
+    for threads in `cat $name.threads`; do
+      if ! timeout $TIMEOUT $fpscalc `options $name` -j $threads < $model > $name.result 2> /dev/null; then
+	echo "$name (-j $threads): failed or didn't end"
+	failed=1
+      elif ! cmp -s $name.out $name.result; then
+	echo "$name (-j $threads): not the same as with one thread"
+	diff $name.out $name.result
+	failed=1
+      else
+	echo "$name (-j $threads): ok"
+      fi
+    done
+  fi
+  rm -f $name.result $name.trace $name.model
+done
+
+for requests in *.serve; do
+  name=`basename $requests .serve`
+  timeout $TIMEOUT $FPSCALC `options $name` --serve < $requests 2> /dev/null | sed "$TIMES" > $name.result
+  if cmp -s $name.replies $name.result; then
+    echo "$name: ok"
+  else
+    echo "$name: wrong replies"
+    diff $name.replies $name.result
+    failed=1
+  fi
+
+  start_server `options $name`
+  timeout $TIMEOUT $CLIENT $SOCKET < $requests | sed "$TIMES" > $name.result
+  stop_server
+  if cmp -s $name.replies $name.result; then
+    echo "$name (socket): ok"
+  else
+    echo "$name (socket): wrong replies"
+    diff $name.replies $name.result
+    failed=1
+  fi
+  rm -f $name.result
+done
+
+# A set, a run and a get, over and over, with a model given to the
+# server with --load
+
+$FPSCALC --compile rate.model < rta.fps 2> /dev/null
+start_server --load rate.model
+printf '%s\n' '{"command":"set","system":"Simple","variable":"C","task":"t1","value":20}' \
+  '{"command":"run"}' '{"command":"get","system":"Simple","variable":"R"}' |
+  timeout $TIMEOUT $CLIENT -n 1000 $SOCKET 2>&1 > /dev/null | sed 's/^/serve: /'
+stop_server
+rm -f rate.model
+
+exit $failed
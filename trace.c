@@ -0,0 +1,172 @@
+/* trace.c
+
+   Timeline trace of the fixed-point iteration (--trace). Spans are
+   recorded as complete events, with their start and duration, into a
+   ring buffer. The trace is written when the program exits, also when
+   it exits on an error.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "trace.h"
+
+struct trace_event {
+  char *category;
+  char *name;
+  char *task;   /* NULL if the span isn't about an element */
+  int thread;
+  int count;   /* NO_COUNT if there is none */
+  double start, duration;   /* In microseconds */
+  double value;   /* NAN if there is none */
+};
+
+int tracing = 0;
+
+static struct trace_event *events;
+static unsigned long next_event;
+static char *trace_file;
+static char *thread_names[TRACE_THREADS];
+static double origin;
+
+static void write_string(FILE *, char *);
+
+/* TRACE_OPEN
+
+   Starts tracing into the given file
+*/
+
+void trace_open(char *file_name)
+{
+  events = malloc(TRACE_EVENTS * sizeof(struct trace_event));
+  if (events == NULL) {
+    fprintf(stderr, "Not enough memory for the trace.\n");
+    exit(-1);
+  }
+  trace_file = file_name;
+  next_event = 0;
+  tracing = 1;
+  origin = 0.0;
+  origin = trace_clock();
+  atexit(trace_close);
+}
+
+/* Names a thread of the timeline */
+
+void trace_name(int thread, char *name)
+{
+  if ((thread >= 0) && (thread < TRACE_THREADS))
+    thread_names[thread] = name;
+}
+
+/* Returns the time since tracing started, in microseconds */
+
+double trace_clock(void)
+{
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return(time.tv_sec * 1e6 + time.tv_nsec / 1e3 - origin);
+}
+
+/* TRACE_SPAN
+
+   Records a span that started at 'start' and ends now. The task, the
+   count and the value are left out if they are NULL, NO_COUNT and
+   NAN. The strings must stay valid until the trace is written. Several
+   threads can record at the same time.
+*/
+
+void trace_span(char *category, char *name, char *task, int thread, double start, int count, double value)
+{
+  struct trace_event *event;
+  double end;
+
+  end = trace_clock();
+  event = &events[__sync_fetch_and_add(&next_event, 1) % TRACE_EVENTS];
+  event->category = category;
+  event->name = name;
+  event->task = task;
+  event->thread = thread;
+  event->start = start;
+  event->duration = end - start;
+  event->count = count;
+  event->value = value;
+}
+
+/* TRACE_CLOSE
+
+   Writes the trace, oldest event first
+*/
+
+void trace_close(void)
+{
+  struct trace_event *event;
+  unsigned long first, counter;
+  FILE *file;
+  int thread;
+  char *separator;
+
+  if (!tracing)
+    return;
+  tracing = 0;
+
+  file = fopen(trace_file, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Can't create `%s'.\n", trace_file);
+    return;
+  }
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  separator = "\n";
+  for (thread = 0; thread < TRACE_THREADS; thread++)
+    if (thread_names[thread] != NULL) {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", separator, thread);
+      write_string(file, thread_names[thread]);
+      fprintf(file, "}}");
+      separator = ",\n";
+    }
+
+  first = (next_event > TRACE_EVENTS) ? next_event - TRACE_EVENTS : 0;
+  for (counter = first; counter < next_event; counter++) {
+    event = &events[counter % TRACE_EVENTS];
+    fprintf(file, "%s{\"name\":", separator);
+    separator = ",\n";
+    if (event->task != NULL) {
+      fputc('"', file);
+      fprintf(file, "%s[%s]", event->name, event->task);
+      fputc('"', file);
+    }
+    else
+      write_string(file, event->name);
+    fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+	    event->category, event->thread, event->start, event->duration);
+    if ((event->count != NO_COUNT) || !isnan(event->value)) {
+      fprintf(file, ",\"args\":{");
+      if (event->count != NO_COUNT)
+	fprintf(file, "\"iterations\":%d%s", event->count, isnan(event->value) ? "" : ",");
+      if (isfinite(event->value))
+	fprintf(file, "\"value\":%.17g", event->value);
+      else if (!isnan(event->value))
+	fprintf(file, "\"value\":\"%s\"", (event->value > 0) ? "inf" : "-inf");
+      fprintf(file, "}");
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  free(events);
+}
+
+static void write_string(FILE *file, char *string)
+{
+  fputc('"', file);
+  for (; *string != '\0'; string++)
+    if ((*string == '"') || (*string == '\\'))
+      fprintf(file, "\\%c", *string);
+    else
+      fputc(*string, file);
+  fputc('"', file);
+}
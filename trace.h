@@ -0,0 +1,24 @@
+#ifndef __TRACE
+#define __TRACE
+
+/* Timeline trace of the analysis (--trace), written in the Chrome
+   trace event format at exit. The events are kept in a ring buffer
+   that is allocated once, so only the latest ones are kept if there
+   are too many. Each system (or scratch system) is a thread of the
+   timeline. */
+
+#define TRACE_EVENTS (1 << 18)
+#define TRACE_THREADS 64
+#define NO_COUNT -1
+
+extern int tracing;
+
+/* Prototypes */
+
+void trace_open(char *);
+void trace_name(int, char *);
+double trace_clock(void);
+void trace_span(char *, char *, char *, int, double, int, double);
+void trace_close(void);
+
+#endif